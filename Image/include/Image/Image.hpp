@@ -33,10 +33,16 @@ odyssee.merveille@gmail.com
 #define IMAGE_INCLUDED
 
 #include <stdlib.h>
+#include <cstddef>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <limits>
+#include <type_traits>
+
+#include "Image/Image_Allocator.hpp"
+#include "Image/Image_Kernels.hpp"
 
 
 // ###################################################################################################################
@@ -51,21 +57,21 @@ public :
 	Image2D(): m_nDimX(0), m_nDimY(0), m_nSize(0) {}
 
 	Image2D( unsigned int dimX, unsigned int dimY, unsigned int value=0 ):
-		 m_nDimX(dimX), m_nDimY(dimY), m_nSize(dimX*dimY), m_vImage(dimX*dimY, value){}
+		 m_nDimX(dimX), m_nDimY(dimY), m_nSize((std::size_t) dimX * dimY), m_vImage(m_nSize, value){}
 
 	~Image2D(){}
 
 	T& operator ()( int x, int y) {
-		return m_vImage[x + y * m_nDimX];
+		return m_vImage[x + (std::size_t) y * m_nDimX];
 	}
 	const T& operator ()( int x, int y) const {
-		return m_vImage[x + y * m_nDimX];
+		return m_vImage[x + (std::size_t) y * m_nDimX];
 	}
 
-	T& operator ()( int i) {
+	T& operator ()( std::size_t i) {
 		return m_vImage[i];
 	}
-	const T& operator ()( int i) const {
+	const T& operator ()( std::size_t i) const {
 		return m_vImage[i];
 	}
 
@@ -77,7 +83,7 @@ public :
 		return m_nDimY;
 	}
 
-	const unsigned int size() const {
+	const std::size_t size() const {
 		return m_nSize;
 	}
 
@@ -112,7 +118,7 @@ public :
 	private :
 		unsigned int m_nDimX;
 		unsigned int m_nDimY;
-		unsigned int m_nSize;
+		std::size_t m_nSize;
 		std::vector<T> m_vImage;
 };
 
@@ -121,7 +127,17 @@ public :
 // ############################################### 3D IMAGE ##########################################################
 // ###################################################################################################################
 
+// Tag selecting the Image3D constructors which leave the voxels uninitialized
+struct uninitialized_t {};
+constexpr uninitialized_t uninitialized{};
+
 template<typename T>
+class Image3DView;
+
+template<typename E>
+struct Image_Expression;
+
+template<typename T, typename Allocator = Image_Allocator<T>>
 class Image3D {
 
 public :
@@ -139,34 +155,92 @@ public :
 		double originY,
 		double originZ,
 		 T value=0):
-		m_nDimX(dimX), m_nDimY(dimY), m_nDimZ(dimZ), m_nSize(dimX*dimY*dimZ), 
-		m_vImage(dimX*dimY*dimZ, value),
+		m_nDimX(dimX), m_nDimY(dimY), m_nDimZ(dimZ), m_nSize((std::size_t) dimX * dimY * dimZ),
+		m_vImage(m_nSize, value),
 		m_spacingX(spacingX),m_spacingY(spacingY),m_spacingZ(spacingZ),
 		m_originX(originX),m_originY(originY),m_originZ(originZ){}
 
 	Image3D( unsigned int dimX, unsigned int dimY, unsigned int dimZ, T value=0 ):
-		m_nDimX(dimX), m_nDimY(dimY), m_nDimZ(dimZ), m_nSize(dimX*dimY*dimZ), m_vImage(dimX*dimY*dimZ, value),
+		m_nDimX(dimX), m_nDimY(dimY), m_nDimZ(dimZ), m_nSize((std::size_t) dimX * dimY * dimZ), m_vImage(m_nSize, value),
 		m_spacingX(1.0),m_spacingY(1.0),m_spacingZ(1.0),
 		m_originX(0.0f),m_originY(0.0f),m_originZ(0.0f){}
 
+	// Voxels are left uninitialized (as long as the allocator default-initializes)
+	Image3D(unsigned int dimX,
+		unsigned int dimY,
+		unsigned int dimZ,
+		float spacingX,
+		float spacingY,
+		float spacingZ,
+		double originX,
+		double originY,
+		double originZ,
+		uninitialized_t):
+		m_nDimX(dimX), m_nDimY(dimY), m_nDimZ(dimZ), m_nSize((std::size_t) dimX * dimY * dimZ),
+		m_spacingX(spacingX),m_spacingY(spacingY),m_spacingZ(spacingZ),
+		m_originX(originX),m_originY(originY),m_originZ(originZ),
+		m_vImage(m_nSize){}
+
+	Image3D( unsigned int dimX, unsigned int dimY, unsigned int dimZ, uninitialized_t ):
+		m_nDimX(dimX), m_nDimY(dimY), m_nDimZ(dimZ), m_nSize((std::size_t) dimX * dimY * dimZ),
+		m_spacingX(1.0),m_spacingY(1.0),m_spacingZ(1.0),
+		m_originX(0.0f),m_originY(0.0f),m_originZ(0.0f),
+		m_vImage(m_nSize){}
+
 	Image3D( const Image3D& image ):
 	 	m_nDimX(image.m_nDimX), m_nDimY(image.m_nDimY), m_nDimZ(image.m_nDimZ), m_nSize(image.m_nSize), m_vImage(image.m_vImage),
 		m_spacingX(image.m_spacingX),m_spacingY(image.m_spacingY),m_spacingZ(image.m_spacingZ),
-		m_originX(0.0f),m_originY(0.0f),m_originZ(0.0f){}
+		m_originX(0.0f),m_originY(0.0f),m_originZ(0.0f), m_nHalo(image.m_nHalo){}
+
+	// The moved-from image is left empty, with null dimensions (as after
+	// clear_image()), so that its size() matches its buffer
+	Image3D( Image3D&& image ) noexcept:
+		m_nDimX(image.m_nDimX), m_nDimY(image.m_nDimY), m_nDimZ(image.m_nDimZ), m_nSize(image.m_nSize),
+		m_spacingX(image.m_spacingX),m_spacingY(image.m_spacingY),m_spacingZ(image.m_spacingZ),
+		m_originX(image.m_originX),m_originY(image.m_originY),m_originZ(image.m_originZ),
+		m_vImage(std::move(image.m_vImage)), m_nHalo(image.m_nHalo) {
+		image.reset_dimensions();
+	}
+
+	Image3D& operator =( const Image3D& image ) = default;
+
+	Image3D& operator =( Image3D&& image ) noexcept {
+		if (this != &image) {
+			m_nDimX = image.m_nDimX;
+			m_nDimY = image.m_nDimY;
+			m_nDimZ = image.m_nDimZ;
+			m_nSize = image.m_nSize;
+			m_vImage = std::move(image.m_vImage);
+			m_spacingX = image.m_spacingX;
+			m_spacingY = image.m_spacingY;
+			m_spacingZ = image.m_spacingZ;
+			m_originX = image.m_originX;
+			m_originY = image.m_originY;
+			m_originZ = image.m_originZ;
+			m_nHalo = image.m_nHalo;
+			image.m_vImage.clear();
+			image.reset_dimensions();
+		}
+		return *this;
+	}
+
+	// Evaluate a lazy expression in this, in one pass (see Image_Expression.hpp)
+	template<typename E>
+	Image3D& operator =( const Image_Expression<E>& expression );
 
 	~Image3D(){}
 
 	T& operator ()( int x, int y, int z ) {
-		return m_vImage[x + y * m_nDimX + z * m_nDimX * m_nDimY];
+		return m_vImage[x + (std::size_t) y * m_nDimX + (std::size_t) z * m_nDimX * m_nDimY];
 	}
 	const T& operator ()( int x, int y, int z ) const {
-		return m_vImage[x + y * m_nDimX + z * m_nDimX * m_nDimY];
+		return m_vImage[x + (std::size_t) y * m_nDimX + (std::size_t) z * m_nDimX * m_nDimY];
 	}
 
-	T& operator ()( int i ) {
+	T& operator ()( std::size_t i ) {
 		return m_vImage[i];
 	}
-	const T& operator ()( int i ) const {
+	const T& operator ()( std::size_t i ) const {
 		return m_vImage[i];
 	}
 
@@ -194,7 +268,7 @@ public :
 		return m_nDimZ;
 	}
 
-	const unsigned int size() const {
+	const std::size_t size() const {
 		return m_nSize;
 	}
 
@@ -226,10 +300,34 @@ public :
 		return m_vImage.empty();
 	}
 
-	std::vector<T>& get_data(){
+	// Width of the halo (border) allocated around the interior of the image.
+	// dimX(), dimY(), dimZ() and size() include the halo.
+	const int halo() const {
+		return m_nHalo;
+	}
+
+	// Address of the first interior voxel. Interior voxel (x, y, z) is at
+	// interior_pointer()[x + y * dimX() + z * dimX() * dimY()], x, y and z
+	// may be negative (down to -halo()) to address the halo.
+	T* interior_pointer() {
+		return &this->operator()(m_nHalo, m_nHalo, m_nHalo);
+	}
+	const T* interior_pointer() const {
+		return &this->operator()(m_nHalo, m_nHalo, m_nHalo);
+	}
+
+	// Voxel (x, y, z) in interior coordinates
+	T& interior( int x, int y, int z ) {
+		return this->operator()(x + m_nHalo, y + m_nHalo, z + m_nHalo);
+	}
+	const T& interior( int x, int y, int z ) const {
+		return this->operator()(x + m_nHalo, y + m_nHalo, z + m_nHalo);
+	}
+
+	std::vector<T, Allocator>& get_data(){
 		return m_vImage;
 	}
-	const std::vector<T>& get_data() const {
+	const std::vector<T, Allocator>& get_data() const {
 		return m_vImage;
 	}
 
@@ -249,17 +347,74 @@ public :
 	void clear_image(){
 		m_vImage.clear();
 		m_vImage.shrink_to_fit(); //clear a vector of all its memory
-		m_nDimX = m_nDimY = m_nDimZ = 0;
-		m_nSize = 0;
+		reset_dimensions();
+	}
+
+	// Read-write view on the voxels of this (halo included)
+	Image3DView<T> view() {
+		return Image3DView<T>(m_vImage.data(), m_nDimX, m_nDimY, m_nDimZ, m_spacingX, m_spacingY, m_spacingZ, m_originX, m_originY, m_originZ);
+	}
+
+	// Read-only view on the voxels of this (halo included)
+	Image3DView<const T> view() const {
+		return Image3DView<const T>(m_vImage.data(), m_nDimX, m_nDimY, m_nDimZ, m_spacingX, m_spacingY, m_spacingZ, m_originX, m_originY, m_originZ);
+	}
+
+	// Return a new image which is the copy of the voxels seen by "image",
+	// with a "border"-pixel border filled with "value". The border is the halo of the new image.
+	static Image3D from_view(const Image3DView<const T> &image, int border=0, int value=0) {
+		return from_view(image, border, value, [](const T& val) { return val; });
+	}
+
+	// Same as from_view, each voxel of "image" being transformed by op on the fly.
+	// Every voxel of the new image is written once: border planes and rows are
+	// filled with "value" and the rows of "image" are copied
+	template<typename UnaryOp>
+	static Image3D from_view(const Image3DView<const T> &image, int border, int value, UnaryOp op) {
+		const unsigned int nDimX = image.dimX();
+		const unsigned int nDimY = image.dimY();
+		const unsigned int nDimZ = image.dimZ();
+
+		Image3D bordered_image(nDimX + 2 * border, nDimY + 2 * border, nDimZ + 2 * border, image.spacingX(), image.spacingY(), image.spacingZ(), image.originX(), image.originY(), image.originZ(), uninitialized);
+		bordered_image.m_nHalo = border;
+		const std::size_t dimX = bordered_image.dimX();
+		const std::size_t frame = dimX * bordered_image.dimY();
+		T* out = bordered_image.get_pointer();
+
+		std::fill(out, out + border * frame, (T) value);
+		for (unsigned int z = 0; z < nDimZ ; ++z) {
+			T* slice = out + (z + border) * frame;
+			std::fill(slice, slice + border * dimX, (T) value);
+			for (unsigned int y = 0 ; y < nDimY ; ++y) {
+				T* row = slice + (y + border) * dimX;
+				std::fill(row, row + border, (T) value);
+				if (image.strideX() == 1) {
+					const T* in = &image(0, y, z);
+					std::transform(in, in + nDimX, row + border, op);
+				}
+				else {
+					for (unsigned int x = 0; x < nDimX; ++x)
+						row[x + border] = op(image(x, y, z));
+				}
+				std::fill(row + border + nDimX, row + dimX, (T) value);
+			}
+			std::fill(slice + (nDimY + border) * dimX, slice + frame, (T) value);
+		}
+		std::fill(out + (nDimZ + border) * frame, out + bordered_image.size(), (T) value);
+		return bordered_image;
 	}
 
 	// Return a new image "bordered_image" which is the self image with a "border"-pixel border
-	Image3D<T> add_border(int border, int value=0) const {
-		Image3D<T> bordered_image(m_nDimX + 2 * border, m_nDimY + 2 * border, m_nDimZ + 2 * border,m_spacingX,m_spacingY,m_spacingZ,m_originX,m_originY,m_originZ, value);
-		for (int z = 0; z < m_nDimZ ; ++z)
-			for (int y = 0 ; y < m_nDimY ; ++y)
-				for (int x = 0 ; x < m_nDimX ; ++x)
-					bordered_image(x + border, y + border, z + border) = this->operator()(x,y,z);
+	// The border is added to the halo of the new image.
+	Image3D add_border(int border, int value=0) const {
+		return add_border(border, value, [](const T& val) { return val; });
+	}
+
+	// Same as add_border, each interior voxel being transformed by op on the fly.
+	template<typename UnaryOp>
+	Image3D add_border(int border, int value, UnaryOp op) const {
+		Image3D bordered_image = from_view(view(), border, value, op);
+		bordered_image.m_nHalo = m_nHalo + border;
 		return bordered_image;
 	}
 
@@ -278,39 +433,73 @@ public :
 
 	// Return a new image "bordered_image" which is the self image without ist "border"-pixel border
 	void remove_border(int border) {
-		int ind=0;
+		std::size_t ind=0;
 		for (int z = border; z<m_nDimZ - border ; ++z)
 			for (int y = border; y<m_nDimY - border; ++y)
 				for (int x = border; x<m_nDimX - border; ++x)
-					m_vImage[ind++]=m_vImage[x + y * m_nDimX + z * m_nDimX * m_nDimY];
+					m_vImage[ind++]=this->operator()(x,y,z);
 
 		m_nDimX -= 2 * border;
 		m_nDimY -= 2 * border;
 		m_nDimZ -= 2 * border;
-		m_nSize = m_nDimX * m_nDimY * m_nDimZ;
+		m_nSize = (std::size_t) m_nDimX * m_nDimY * m_nDimZ;
+		m_nHalo = std::max(0, m_nHalo - border);
+		m_vImage.resize(size());
+	}
+
+	// Remove the whole halo in place, each interior voxel being combined with
+	// the voxel at the same position in "image" (an Image3D without halo or a view):
+	// this = op(interior, image). The compaction and the combination are done
+	// in the same pass.
+	template<typename BinaryOp>
+	void remove_halo(const Image3DView<const T> &image, BinaryOp op) {
+		const int border = m_nHalo;
+		const unsigned int dimX = m_nDimX - 2 * border;
+		const unsigned int dimY = m_nDimY - 2 * border;
+		const unsigned int dimZ = m_nDimZ - 2 * border;
+
+		if ((std::size_t) dimX * dimY * dimZ != image.size()) {
+			std::cout<<"Error in Image.hpp (remove_halo): "
+					 <<"Size of the interior and of the image is not the same."<<std::endl;
+			return;
+		}
+
+		T* out = m_vImage.data();
+		for (unsigned int z = 0; z < dimZ ; ++z)
+			for (unsigned int y = 0; y < dimY; ++y) {
+				const T* row = &interior(0, y, z);
+				for (unsigned int x = 0; x < dimX; ++x)
+					*out++ = op(row[x], image(x, y, z));
+			}
+
+		m_nDimX = dimX;
+		m_nDimY = dimY;
+		m_nDimZ = dimZ;
+		m_nSize = image.size();
+		m_nHalo = 0;
 		m_vImage.resize(size());
 	}
 
 	// return a new image which is the copy of this
 	const Image3D<unsigned char> copy_image_2_uchar() const {
+		return view().copy_image_2_uchar();
+	}
 
-		Image3D<unsigned char> copy(m_nDimX , m_nDimY , m_nDimZ, m_spacingX, m_spacingY, m_spacingZ,m_originX,m_originY,m_originZ);
-		auto it1 = m_vImage.begin();
-		auto it2 = copy.get_data().begin();
-		for ( ; it1 != m_vImage.end() ; ++it1, ++it2 )
-					*it2 = (unsigned char)(*it1);
-		return copy;
+	// return a new uint8 image, window_dynamic() of this (see Image3DView)
+	const Image3D<unsigned char> copy_image_window_2_uchar( const T& window_min, const T& window_max ) const {
+		return view().copy_image_window_2_uchar(window_min, window_max);
 	}
 
 	// return a new image which is the copy of this
 	Image3D copy_image() const {
-		Image3D copy(m_nDimX , m_nDimY , m_nDimZ,m_spacingX,m_spacingY,m_spacingZ,m_originX,m_originY,m_originZ);
-		copy.add_data_from_pointer(m_vImage.data());
+		Image3D copy(m_nDimX , m_nDimY , m_nDimZ,m_spacingX,m_spacingY,m_spacingZ,m_originX,m_originY,m_originZ, uninitialized);
+		std::copy(m_vImage.begin(), m_vImage.end(), copy.get_data().begin());
+		copy.m_nHalo = m_nHalo;
 		return copy;
 	}
 
 	// Copy I into this
-	void copy_image(Image3D<T> &image) {
+	void copy_image(const Image3D &image) {
 		if (image.size() != size())
 		{
 			m_nDimX = image.dimX();
@@ -328,50 +517,343 @@ public :
 			m_originZ = image.originZ();
 		}
 		m_vImage.assign(image.get_data().begin(),image.get_data().end());
+		m_nHalo = image.halo();
 	}
 
 
 	// Return the maximum value of this
 	int min_value() const {
-		return *(std::min_element(m_vImage.begin(),m_vImage.end()));
+		return view().min_value();
 	}
 
 
 	// Return the maximum value of this
 	int max_value() const {
-		return *(std::max_element(m_vImage.begin(),m_vImage.end()));
+		return view().max_value();
 	}
 
 	// Return the minimum and maximum value of this
 	std::pair<T,T> min_max_value() const {
-        auto minmax = std::minmax_element(m_vImage.begin(),m_vImage.end());
-		return { *minmax.first, *minmax.second };
+		return view().min_max_value();
 	}
 
 	// Change the dynamique of image, from [window_min, window_max] to [0, 255]. Intensities smaller than window_min are set to 0 and larger than window_max are set to 255
 	void window_dynamic( const T& window_min, const T& window_max ){
-		for (auto& val: m_vImage)
-        {
+		view().window_dynamic(window_min, window_max);
+	}
+
+    // Change  the dynamique of image this from [min_value, max_value] to [ 0 , max_value]
+	void turn_positive(int min_value, int max_value){
+		view().turn_positive(min_value, max_value);
+	}
+
+	private :
+		void reset_dimensions() {
+			m_nDimX = m_nDimY = m_nDimZ = 0;
+			m_nSize = 0;
+			m_nHalo = 0;
+		}
+
+		unsigned int m_nDimX;
+		unsigned int m_nDimY;
+		unsigned int m_nDimZ;
+		std::size_t m_nSize;
+
+		float m_spacingX;
+		float m_spacingY;
+		float m_spacingZ;
+
+		double m_originX;
+		double m_originY;
+		double m_originZ;
+
+		std::vector<T, Allocator>m_vImage;
+
+		int m_nHalo = 0;
+};
+
+// ###################################################################################################################
+// ############################################# 3D IMAGE VIEW #######################################################
+// ###################################################################################################################
+
+// Non-owning view on a 3D image stored in memory owned by someone else
+// (an Image3D, a numpy array, an ITK image, ...). Nothing is copied: the
+// memory must outlive the view. T is const for a read-only view.
+// Strides are given in number of voxels, voxel (x, y, z) is at
+// data[x * strideX + y * strideY + z * strideZ].
+template<typename T>
+class Image3DView {
+
+public :
+
+	typedef typename std::remove_const<T>::type value_type;
+
+	Image3DView(): m_pData(nullptr), m_nDimX(0), m_nDimY(0), m_nDimZ(0),
+		m_nStrideX(1), m_nStrideY(0), m_nStrideZ(0),
+		m_spacingX(1.0), m_spacingY(1.0), m_spacingZ(1.0),
+		m_originX(0.0), m_originY(0.0), m_originZ(0.0) {}
+
+	// View on a contiguous buffer (x fastest)
+	Image3DView(T* data,
+		unsigned int dimX,
+		unsigned int dimY,
+		unsigned int dimZ,
+		float spacingX=1.0,
+		float spacingY=1.0,
+		float spacingZ=1.0,
+		double originX=0.0,
+		double originY=0.0,
+		double originZ=0.0):
+		Image3DView(data, dimX, dimY, dimZ, 1, dimX, (std::ptrdiff_t) dimX * dimY,
+			spacingX, spacingY, spacingZ, originX, originY, originZ) {}
+
+	// View on a strided buffer
+	Image3DView(T* data,
+		unsigned int dimX,
+		unsigned int dimY,
+		unsigned int dimZ,
+		std::ptrdiff_t strideX,
+		std::ptrdiff_t strideY,
+		std::ptrdiff_t strideZ,
+		float spacingX,
+		float spacingY,
+		float spacingZ,
+		double originX,
+		double originY,
+		double originZ):
+		m_pData(data), m_nDimX(dimX), m_nDimY(dimY), m_nDimZ(dimZ),
+		m_nStrideX(strideX), m_nStrideY(strideY), m_nStrideZ(strideZ),
+		m_spacingX(spacingX), m_spacingY(spacingY), m_spacingZ(spacingZ),
+		m_originX(originX), m_originY(originY), m_originZ(originZ) {}
+
+	// Read-only view on an Image3D, so that an Image3D can be given
+	// wherever a read-only view is expected
+	template<typename Allocator, typename U = T,
+		typename = typename std::enable_if<std::is_const<U>::value>::type>
+	Image3DView( const Image3D<value_type, Allocator>& image ):
+		Image3DView(image.view()) {}
+
+	// Read-only view from a read-write view
+	template<typename U = T,
+		typename = typename std::enable_if<std::is_const<U>::value>::type>
+	Image3DView( const Image3DView<value_type>& view ):
+		Image3DView(view.get_pointer(), view.dimX(), view.dimY(), view.dimZ(),
+			view.strideX(), view.strideY(), view.strideZ(),
+			view.spacingX(), view.spacingY(), view.spacingZ(),
+			view.originX(), view.originY(), view.originZ()) {}
+
+	// Like a pointer, a const view may give write access to the voxels
+	T& operator ()( int x, int y, int z ) const {
+		return m_pData[x * m_nStrideX + y * m_nStrideY + z * m_nStrideZ];
+	}
+
+	// Only for contiguous views
+	T& operator ()( std::size_t i ) const {
+		return m_pData[i];
+	}
+
+	const unsigned int dimX() const {
+		return m_nDimX;
+	}
+
+	const unsigned int dimY() const {
+		return m_nDimY;
+	}
+
+	const unsigned int dimZ() const {
+		return m_nDimZ;
+	}
+
+	const std::size_t size() const {
+		return (std::size_t) m_nDimX * m_nDimY * m_nDimZ;
+	}
+
+	const std::ptrdiff_t strideX() const {
+		return m_nStrideX;
+	}
+
+	const std::ptrdiff_t strideY() const {
+		return m_nStrideY;
+	}
+
+	const std::ptrdiff_t strideZ() const {
+		return m_nStrideZ;
+	}
+
+	const float spacingX() const{
+		return m_spacingX;
+	}
+
+	const float spacingY() const{
+		return m_spacingY;
+	}
+
+	const float spacingZ()const{
+		return m_spacingZ;
+	}
+
+	const double originX() const{
+		return m_originX;
+	}
+
+	const double originY() const{
+		return m_originY;
+	}
+
+	const double originZ() const{
+		return m_originZ;
+	}
+
+	bool empty() const {
+		return m_pData == nullptr || size() == 0;
+	}
+
+	// True if the voxels are stored as in an Image3D without halo
+	bool is_contiguous() const {
+		return m_nStrideX == 1 && m_nStrideY == m_nDimX && m_nStrideZ == (std::ptrdiff_t) m_nDimX * m_nDimY;
+	}
+
+	T* get_pointer() const {
+		return m_pData;
+	}
+
+	// Apply f to every voxel, x fastest then y then z (the order of the voxels in an Image3D)
+	template<typename Function>
+	void for_each( Function f ) const {
+		if (is_contiguous()) {
+			std::for_each(m_pData, m_pData + size(), f);
+			return;
+		}
+		for (unsigned int z = 0; z < m_nDimZ ; ++z)
+			for (unsigned int y = 0; y < m_nDimY; ++y) {
+				T* row = &this->operator()(0, y, z);
+				for (unsigned int x = 0; x < m_nDimX; ++x)
+					f(row[x * m_nStrideX]);
+			}
+	}
+
+	// return a new image which is the copy of this
+	const Image3D<unsigned char> copy_image_2_uchar() const {
+		Image3D<unsigned char> copy(m_nDimX , m_nDimY , m_nDimZ, m_spacingX, m_spacingY, m_spacingZ,m_originX,m_originY,m_originZ, uninitialized);
+		auto it2 = copy.get_data().begin();
+		for_each([&it2](const T& val) { *it2++ = (unsigned char)(val); });
+		return copy;
+	}
+
+	// Return the minimum value of this
+	value_type min_value() const {
+		if (is_contiguous())
+			return parallel_min_max<value_type>(m_pData, size()).first;
+		value_type minimum = *m_pData;
+		for_each([&minimum](const T& val) { minimum = std::min(minimum, val); });
+		return minimum;
+	}
+
+	// Return the maximum value of this
+	value_type max_value() const {
+		if (is_contiguous())
+			return parallel_min_max<value_type>(m_pData, size()).second;
+		value_type maximum = *m_pData;
+		for_each([&maximum](const T& val) { maximum = std::max(maximum, val); });
+		return maximum;
+	}
+
+	// Return the minimum and maximum value of this
+	std::pair<value_type,value_type> min_max_value() const {
+		if (is_contiguous())
+			return parallel_min_max<value_type>(m_pData, size());
+		std::pair<value_type,value_type> minmax(*m_pData, *m_pData);
+		for_each([&minmax](const T& val) {
+			minmax.first = std::min(minmax.first, val);
+			minmax.second = std::max(minmax.second, val);
+		});
+		return minmax;
+	}
+
+	// Change the dynamique of image, from [window_min, window_max] to [0, 255]. Intensities smaller than window_min are set to 0 and larger than window_max are set to 255
+	void window_dynamic( const value_type& window_min, const value_type& window_max ) const {
+		auto window = [window_min, window_max](T& val) {
 			if (val <= window_min)
 				val = 0;
 			else if (val > window_max)
 				 val = 255;
 			else
-				val = (T)(255 * ((val - (float)window_min) / (window_max - window_min)));
+				val = (value_type)(255 * ((val - (float)window_min) / (window_max - window_min)));
+		};
+		if (is_contiguous()) {
+			T* data = m_pData;
+			parallel_simd_for(size(), [data, &window](std::ptrdiff_t i) { window(data[i]); });
 		}
+		else
+			for_each(window);
+	}
+
+	// Return a new uint8 image, the same as window_dynamic() followed by
+	// copy_image_2_uchar() but in a single pass and without modifying this.
+	// Integer types up to 16 bits are converted with a table of their 2^16
+	// values.
+	const Image3D<unsigned char> copy_image_window_2_uchar( const value_type& window_min, const value_type& window_max ) const {
+		Image3D<unsigned char> copy(m_nDimX , m_nDimY , m_nDimZ, m_spacingX, m_spacingY, m_spacingZ,m_originX,m_originY,m_originZ, uninitialized);
+		unsigned char* out = copy.get_pointer();
+
+		auto window = [window_min, window_max](value_type val) {
+			if (val <= window_min)
+				val = 0;
+			else if (val > window_max)
+				 val = 255;
+			else
+				val = (value_type)(255 * ((val - (float)window_min) / (window_max - window_min)));
+			return (unsigned char)(val);
+		};
+
+		if constexpr (std::is_integral<value_type>::value && sizeof(value_type) <= 2) {
+			const std::ptrdiff_t lowest = std::numeric_limits<value_type>::min();
+			std::vector<unsigned char> table((std::size_t) 1 << (8 * sizeof(value_type)));
+			for (std::size_t v = 0; v < table.size(); v++)
+				table[v] = window((value_type)(lowest + (std::ptrdiff_t) v));
+
+			const unsigned char* lut = table.data();
+			if (is_contiguous()) {
+				const T* data = m_pData;
+				parallel_simd_for(size(), [data, out, lut, lowest](std::ptrdiff_t i) { out[i] = lut[data[i] - lowest]; });
+			}
+			else
+				for_each([&out, lut, lowest](const T& val) { *out++ = lut[val - lowest]; });
+		}
+		else {
+			if (is_contiguous()) {
+				const T* data = m_pData;
+				parallel_simd_for(size(), [data, out, &window](std::ptrdiff_t i) { out[i] = window(data[i]); });
+			}
+			else
+				for_each([&out, &window](const T& val) { *out++ = window(val); });
+		}
+		return copy;
 	}
 
     // Change  the dynamique of image this from [min_value, max_value] to [ 0 , max_value]
-	void turn_positive(int min_value, int max_value){
-        for (auto& val: m_vImage)
-    		val = (T)(max_value * ((val - (float) min_value) / (max_value - min_value)));
+	void turn_positive(int min_value, int max_value) const {
+		auto positive = [min_value, max_value](T& val) {
+			val = (value_type)(max_value * ((val - (float) min_value) / (max_value - min_value)));
+		};
+		if (is_contiguous()) {
+			T* data = m_pData;
+			parallel_simd_for(size(), [data, &positive](std::ptrdiff_t i) { positive(data[i]); });
+		}
+		else
+			for_each(positive);
 	}
 
 	private :
+		T* m_pData;
+
 		unsigned int m_nDimX;
 		unsigned int m_nDimY;
 		unsigned int m_nDimZ;
-		unsigned int m_nSize;
+
+		std::ptrdiff_t m_nStrideX;
+		std::ptrdiff_t m_nStrideY;
+		std::ptrdiff_t m_nStrideZ;
 
 		float m_spacingX;
 		float m_spacingY;
@@ -380,10 +862,13 @@ public :
 		double m_originX;
 		double m_originY;
 		double m_originZ;
-
-		std::vector<T>m_vImage;
 };
 
+// Read-only view parameter of the algorithms. T is not deduced from it, so
+// an Image3D<T> or an Image3DView<T> argument converts to it implicitly.
+template<typename T>
+using Image3DConstView = typename std::enable_if<true, Image3DView<const T>>::type;
+
 template<typename T1, typename T2>
 void operator +(Image3D<T1> &image, T2 scalar){
 	for (auto& val: image.get_data())
@@ -396,4 +881,6 @@ void operator -(Image3D<T1> &image, T2 scalar){
         val -= scalar;
 }
 
+#include "Image/Image_Expression.hpp"
+
 #endif // IMAGE_INCLUDED
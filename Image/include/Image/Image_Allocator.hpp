@@ -0,0 +1,383 @@
+/* Copyright (C) 2014 Odyssee Merveille
+odyssee.merveille@gmail.com
+
+	This software is a computer program whose purpose is to compute RORPO.
+	This software is governed by the CeCILL-B license under French law and
+	abiding by the rules of distribution of free software.  You can  use,
+	modify and/ or redistribute the software under the terms of the CeCILL-B
+	license as circulated by CEA, CNRS and INRIA at the following URL
+	"http://www.cecill.info".
+
+	As a counterpart to the access to the source code and  rights to copy,
+	modify and redistribute granted by the license, users are provided only
+	with a limited warranty  and the software's author,  the holder of the
+	economic rights,  and the successive licensors  have only  limited
+	liability.
+
+	In this respect, the user's attention is drawn to the risks associated
+	with loading,  using,  modifying and/or developing or reproducing the
+	software by the user in light of its specific status of free software,
+	that may mean  that it is complicated to manipulate,  and  that  also
+	therefore means  that it is reserved for developers  and  experienced
+	professionals having in-depth computer knowledge. Users are therefore
+	encouraged to load and test the software's suitability as regards their
+	requirements in conditions enabling the security of their systems and/or
+	data to be ensured and,  more generally, to use and operate it in the
+	same conditions as regards security.
+
+	The fact that you are presently reading this means that you have had
+	knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#ifndef IMAGE_ALLOCATOR_INCLUDED
+#define IMAGE_ALLOCATOR_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <new>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "Image/Image_Numa.hpp"
+
+// Alignment (in bytes) of the image buffers, enough for AVX-512 loads
+#define IMAGE_ALIGNMENT 64
+
+// Size (in bytes) of a transparent huge page
+#define IMAGE_HUGE_PAGE_SIZE ((std::size_t) 2 << 20)
+
+
+// ###################################################################################################################
+// ############################################ HUGE PAGES ###########################################################
+// ###################################################################################################################
+
+// Transparent huge pages (Linux) for the large buffers accessed at random by
+// the Path Opening: the whole huge pages of a buffer are advised
+// (madvise MADV_HUGEPAGE) before it is first written, and the kernel falls
+// back to 4 kB pages when no huge page is free.
+// With track(true), account() adds a written buffer and the part of it
+// backed by huge pages (AnonHugePages of /proc/self/smaps) to the report.
+class Huge_Pages {
+
+public :
+
+	static Huge_Pages& instance() {
+		static Huge_Pages huge_pages;
+		return huge_pages;
+	}
+
+	// Enabled by default
+	void enable( bool enabled = true ) {
+		m_enabled = enabled;
+	}
+
+	bool enabled() const {
+		return m_enabled;
+	}
+
+	void track( bool tracking = true ) {
+		m_tracking = tracking;
+	}
+
+	bool tracking() const {
+		return m_tracking;
+	}
+
+	// To be called before the buffer is written
+	void advise( void* buffer, std::size_t bytes ) const {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+		if (!m_enabled || bytes < IMAGE_HUGE_PAGE_SIZE)
+			return;
+		const std::uintptr_t begin = ((std::uintptr_t) buffer + IMAGE_HUGE_PAGE_SIZE - 1) / IMAGE_HUGE_PAGE_SIZE * IMAGE_HUGE_PAGE_SIZE;
+		const std::uintptr_t end = ((std::uintptr_t) buffer + bytes) / IMAGE_HUGE_PAGE_SIZE * IMAGE_HUGE_PAGE_SIZE;
+		if (end > begin)
+			madvise((void*) begin, end - begin, MADV_HUGEPAGE);
+#endif
+	}
+
+	// To be called once the buffer is written
+	void account( const void* buffer, std::size_t bytes ) {
+		if (!m_tracking || bytes < IMAGE_HUGE_PAGE_SIZE)
+			return;
+		m_nAccounted += bytes;
+		m_nBacked += backed(buffer, bytes);
+	}
+
+	// Bytes of the buffers given to account(), and backed by huge pages
+	std::size_t accounted_bytes() const {
+		return m_nAccounted;
+	}
+
+	std::size_t backed_bytes() const {
+		return m_nBacked;
+	}
+
+	void reset() {
+		m_nAccounted = 0;
+		m_nBacked = 0;
+	}
+
+	private :
+		Huge_Pages(): m_enabled(true), m_tracking(false), m_nAccounted(0), m_nBacked(0) {}
+
+		// Huge pages of the mappings overlapping the buffer, at most their
+		// overlap with the buffer
+		static std::size_t backed( const void* buffer, std::size_t bytes ) {
+			std::size_t huge = 0;
+#ifdef __linux__
+			const std::uintptr_t first = (std::uintptr_t) buffer;
+			const std::uintptr_t last = first + bytes;
+			std::ifstream smaps("/proc/self/smaps");
+			std::string line;
+			std::size_t overlap = 0;
+			while (std::getline(smaps, line)) {
+				std::uintptr_t start, end;
+				char dash;
+				std::istringstream header(line);
+				if (line.find(':') == std::string::npos || line.find('-') < line.find(':')) {
+					if (header >> std::hex >> start >> dash >> end && dash == '-')
+						overlap = (start < last && end > first) ? std::min(end, last) - std::max(start, first) : 0;
+					continue;
+				}
+				if (overlap > 0 && line.compare(0, 14, "AnonHugePages:") == 0) {
+					std::size_t kB = 0;
+					std::istringstream(line.substr(14)) >> kB;
+					huge += std::min(kB << 10, overlap);
+				}
+			}
+#endif
+			return huge;
+		}
+
+		std::atomic<bool> m_enabled;
+		std::atomic<bool> m_tracking;
+		std::atomic<std::size_t> m_nAccounted;
+		std::atomic<std::size_t> m_nBacked;
+};
+
+
+// ###################################################################################################################
+// ############################################ IMAGE BUFFER POOL ####################################################
+// ###################################################################################################################
+
+// Process-wide cache of image buffers, indexed by their size in bytes.
+// When enabled, a released buffer is kept and handed back to the next
+// allocation of the same size instead of being returned to the system.
+// RORPO allocates the same full-volume temporaries at every scale, so this
+// removes most of the allocations (and page faults) after the first scale,
+// at the price of keeping them: the pool is off by default, and a caller
+// enables it (Image_Buffer_Pool_Scope) around the calls to RORPO.
+// With Numa_Placement enabled, a buffer lying on the node of the caller is
+// preferred.
+class Image_Buffer_Pool {
+
+public :
+
+	// Never destroyed, so that images with static storage can still release
+	// their buffer at exit
+	static Image_Buffer_Pool& instance() {
+		static Image_Buffer_Pool* pool = new Image_Buffer_Pool();
+		return *pool;
+	}
+
+	// Enable or disable the recycling of buffers. Disabling the pool frees
+	// all the cached buffers.
+	void enable( bool enabled = true ) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_enabled = enabled;
+		}
+		if (!enabled)
+			clear();
+	}
+
+	bool enabled() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_enabled;
+	}
+
+	// Return a buffer of "bytes" bytes, aligned on IMAGE_ALIGNMENT
+	void* acquire( std::size_t bytes ) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_buffers.find(bytes);
+			if (it != m_buffers.end() && !it->second.empty()) {
+				std::vector<Cached_Buffer> &buffers = it->second;
+				std::size_t i = buffers.size() - 1;
+				if (Numa_Placement::instance().enabled()) {
+					const int node = Numa_Placement::instance().current_node();
+					for (std::size_t j = buffers.size(); j-- > 0; )
+						if (buffers[j].node == node) {
+							i = j;
+							break;
+						}
+				}
+				void* buffer = buffers[i].buffer;
+				buffers.erase(buffers.begin() + i);
+				m_cachedBytes -= bytes;
+				return buffer;
+			}
+		}
+		void* buffer = allocate(bytes);
+		Huge_Pages::instance().advise(buffer, bytes);
+		return buffer;
+	}
+
+	// Give back a buffer obtained with acquire()
+	void release( void* buffer, std::size_t bytes ) {
+		const int node = Numa_Placement::instance().node_of(buffer);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_enabled) {
+				m_buffers[bytes].push_back({buffer, node});
+				m_cachedBytes += bytes;
+				return;
+			}
+		}
+		deallocate(buffer, bytes);
+	}
+
+	// Free all the cached buffers
+	void clear() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& buffers: m_buffers)
+			for (const Cached_Buffer& cached: buffers.second)
+				deallocate(cached.buffer, buffers.first);
+		m_buffers.clear();
+		m_cachedBytes = 0;
+	}
+
+	// Number of bytes currently kept in the pool
+	std::size_t cached_bytes() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_cachedBytes;
+	}
+
+	private :
+		// The large buffers are mapped directly: once glibc has freed one it
+		// raises its mmap threshold and takes the next ones from the heap,
+		// where the freed pages stay resident between the scales
+		static void* allocate( std::size_t bytes ) {
+#ifdef __linux__
+			if (bytes >= IMAGE_HUGE_PAGE_SIZE) {
+				void* buffer = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (buffer == MAP_FAILED)
+					throw std::bad_alloc();
+				return buffer;
+			}
+#endif
+			return ::operator new(bytes, std::align_val_t(IMAGE_ALIGNMENT));
+		}
+
+		static void deallocate( void* buffer, std::size_t bytes ) {
+#ifdef __linux__
+			if (bytes >= IMAGE_HUGE_PAGE_SIZE) {
+				munmap(buffer, bytes);
+				return;
+			}
+#endif
+			::operator delete(buffer, std::align_val_t(IMAGE_ALIGNMENT));
+		}
+
+		Image_Buffer_Pool(): m_enabled(false), m_cachedBytes(0) {}
+		Image_Buffer_Pool( const Image_Buffer_Pool& ) = delete;
+		Image_Buffer_Pool& operator =( const Image_Buffer_Pool& ) = delete;
+
+		std::mutex m_mutex;
+		bool m_enabled;
+		std::size_t m_cachedBytes;
+		struct Cached_Buffer {
+			void* buffer;
+			int node;
+		};
+
+		std::unordered_map<std::size_t, std::vector<Cached_Buffer>> m_buffers;
+};
+
+// Enable the buffer pool for the lifetime of this object. If the pool was
+// already enabled by the caller it is left untouched, so buffers are kept
+// across calls.
+class Image_Buffer_Pool_Scope {
+
+public :
+
+	Image_Buffer_Pool_Scope(): m_wasEnabled(Image_Buffer_Pool::instance().enabled()) {
+		Image_Buffer_Pool::instance().enable(true);
+	}
+
+	~Image_Buffer_Pool_Scope() {
+		if (!m_wasEnabled)
+			Image_Buffer_Pool::instance().enable(false);
+	}
+
+	private :
+		bool m_wasEnabled;
+};
+
+
+// ###################################################################################################################
+// ############################################ IMAGE ALLOCATOR ######################################################
+// ###################################################################################################################
+
+// Default allocator of Image3D: IMAGE_ALIGNMENT-aligned buffers taken from
+// Image_Buffer_Pool, and default-initialization of the elements, so that
+// resizing an image of a trivial type does not write the whole buffer.
+template<typename T>
+class Image_Allocator {
+
+public :
+
+	typedef T value_type;
+
+	template<typename U>
+	struct rebind {
+		typedef Image_Allocator<U> other;
+	};
+
+	Image_Allocator() noexcept {}
+
+	template<typename U>
+	Image_Allocator( const Image_Allocator<U>& ) noexcept {}
+
+	T* allocate( std::size_t n ) {
+		return static_cast<T*>(Image_Buffer_Pool::instance().acquire(n * sizeof(T)));
+	}
+
+	void deallocate( T* p, std::size_t n ) noexcept {
+		Image_Buffer_Pool::instance().release(p, n * sizeof(T));
+	}
+
+	// Default-initialization instead of value-initialization
+	template<typename U>
+	void construct( U* p ) noexcept(noexcept(::new((void*)p) U)) {
+		::new((void*)p) U;
+	}
+
+	template<typename U, typename... Args>
+	void construct( U* p, Args&&... args ) {
+		::new((void*)p) U(std::forward<Args>(args)...);
+	}
+};
+
+template<typename T1, typename T2>
+bool operator ==( const Image_Allocator<T1>&, const Image_Allocator<T2>& ) {
+	return true;
+}
+
+template<typename T1, typename T2>
+bool operator !=( const Image_Allocator<T1>&, const Image_Allocator<T2>& ) {
+	return false;
+}
+
+#endif // IMAGE_ALLOCATOR_INCLUDED
@@ -0,0 +1,370 @@
+/* Copyright (C) 2014 Odyssee Merveille
+odyssee.merveille@gmail.com
+
+	This software is a computer program whose purpose is to compute RORPO.
+	This software is governed by the CeCILL-B license under French law and
+	abiding by the rules of distribution of free software.  You can  use,
+	modify and/ or redistribute the software under the terms of the CeCILL-B
+	license as circulated by CEA, CNRS and INRIA at the following URL
+	"http://www.cecill.info".
+
+	As a counterpart to the access to the source code and  rights to copy,
+	modify and redistribute granted by the license, users are provided only
+	with a limited warranty  and the software's author,  the holder of the
+	economic rights,  and the successive licensors  have only  limited
+	liability.
+
+	In this respect, the user's attention is drawn to the risks associated
+	with loading,  using,  modifying and/or developing or reproducing the
+	software by the user in light of its specific status of free software,
+	that may mean  that it is complicated to manipulate,  and  that  also
+	therefore means  that it is reserved for developers  and  experienced
+	professionals having in-depth computer knowledge. Users are therefore
+	encouraged to load and test the software's suitability as regards their
+	requirements in conditions enabling the security of their systems and/or
+	data to be ensured and,  more generally, to use and operate it in the
+	same conditions as regards security.
+
+	The fact that you are presently reading this means that you have had
+	knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#ifndef IMAGE_EXPRESSION_INCLUDED
+#define IMAGE_EXPRESSION_INCLUDED
+
+#include "Image/Image.hpp"
+
+#include <cstddef>
+#include <iostream>
+#include <algorithm>
+#include <type_traits>
+
+// Lazy arithmetic on images. expr_min, expr_max, expr_diff, expr_scale,
+// expr_mask and expr_clamp take images, views or expressions and only build
+// an expression; assigning it to an Image3D (or evaluate()) computes all the
+// operations voxel by voxel in a single parallel pass, without the
+// intermediate images:
+//
+//     RORPO_res = expr_max(RORPO_res, expr_diff(Imin4, expr_min(Imin4, RPO5_geo)));
+//
+// The operands are read through Image3DView, they must stay alive until the
+// expression is evaluated and have the same dimensions. The destination may
+// be one of the operands.
+
+
+// Position of a voxel, for the operands which are not contiguous
+struct Voxel_Position {
+	int x;
+	int y;
+	int z;
+};
+
+// Base of the expressions (CRTP)
+template<typename E>
+struct Image_Expression {
+	const E& self() const {
+		return static_cast<const E&>(*this);
+	}
+};
+
+
+// ###################################################################################################################
+// ############################################ EXPRESSION NODES #####################################################
+// ###################################################################################################################
+
+// Leaf: the voxels of an image or a view
+template<typename T>
+class Image_Terminal: public Image_Expression<Image_Terminal<T>> {
+
+public :
+
+	typedef T value_type;
+
+	explicit Image_Terminal( const Image3DView<const T>& view ): m_view(view), m_pData(view.get_pointer()) {}
+
+	T get( std::ptrdiff_t i ) const {
+		return m_pData[i];
+	}
+
+	T get( const Voxel_Position& p ) const {
+		return m_view(p.x, p.y, p.z);
+	}
+
+	// First operand: dimensions, spacing and origin of the result
+	const Image3DView<const T>& geometry() const {
+		return m_view;
+	}
+
+	bool contiguous() const {
+		return m_view.is_contiguous();
+	}
+
+	template<typename View>
+	bool same_dimensions( const View& geometry ) const {
+		return m_view.dimX() == geometry.dimX() && m_view.dimY() == geometry.dimY() && m_view.dimZ() == geometry.dimZ();
+	}
+
+	private :
+		Image3DView<const T> m_view;
+		const T* m_pData;
+};
+
+// Binary operation on two expressions of the same type
+template<typename A, typename B, typename Op>
+class Image_Binary: public Image_Expression<Image_Binary<A, B, Op>> {
+
+public :
+
+	typedef typename A::value_type value_type;
+
+	static_assert(std::is_same<value_type, typename B::value_type>::value,
+		"Image_Expression: the operands must have the same type");
+
+	Image_Binary( const A& a, const B& b ): m_a(a), m_b(b) {}
+
+	template<typename Index>
+	value_type get( const Index& i ) const {
+		return Op::apply(m_a.get(i), m_b.get(i));
+	}
+
+	const auto& geometry() const {
+		return m_a.geometry();
+	}
+
+	bool contiguous() const {
+		return m_a.contiguous() && m_b.contiguous();
+	}
+
+	template<typename View>
+	bool same_dimensions( const View& geometry ) const {
+		return m_a.same_dimensions(geometry) && m_b.same_dimensions(geometry);
+	}
+
+	private :
+		A m_a;
+		B m_b;
+};
+
+// Operation on an expression and scalar parameters
+template<typename A, typename Op>
+class Image_Unary: public Image_Expression<Image_Unary<A, Op>> {
+
+public :
+
+	typedef typename A::value_type value_type;
+
+	Image_Unary( const A& a, const Op& op ): m_a(a), m_op(op) {}
+
+	template<typename Index>
+	value_type get( const Index& i ) const {
+		return m_op(m_a.get(i));
+	}
+
+	const auto& geometry() const {
+		return m_a.geometry();
+	}
+
+	bool contiguous() const {
+		return m_a.contiguous();
+	}
+
+	template<typename View>
+	bool same_dimensions( const View& geometry ) const {
+		return m_a.same_dimensions(geometry);
+	}
+
+	private :
+		A m_a;
+		Op m_op;
+};
+
+// Expression set to 0 where the mask (of another type) is 0
+template<typename A, typename MaskType>
+class Image_Masked: public Image_Expression<Image_Masked<A, MaskType>> {
+
+public :
+
+	typedef typename A::value_type value_type;
+
+	Image_Masked( const A& a, const Image_Terminal<MaskType>& mask ): m_a(a), m_mask(mask) {}
+
+	template<typename Index>
+	value_type get( const Index& i ) const {
+		return m_mask.get(i) == 0 ? value_type(0) : m_a.get(i);
+	}
+
+	const auto& geometry() const {
+		return m_a.geometry();
+	}
+
+	bool contiguous() const {
+		return m_a.contiguous() && m_mask.contiguous();
+	}
+
+	template<typename View>
+	bool same_dimensions( const View& geometry ) const {
+		return m_a.same_dimensions(geometry) && m_mask.same_dimensions(geometry);
+	}
+
+	private :
+		A m_a;
+		Image_Terminal<MaskType> m_mask;
+};
+
+struct Image_Min_Op {
+	template<typename T>
+	static T apply( const T& a, const T& b ) { return std::min(a, b); }
+};
+
+struct Image_Max_Op {
+	template<typename T>
+	static T apply( const T& a, const T& b ) { return std::max(a, b); }
+};
+
+struct Image_Diff_Op {
+	template<typename T>
+	static T apply( const T& a, const T& b ) { return a - b; }
+};
+
+// Multiply by max_out / max_in, as the contrast enhancement of RORPO_multiscale
+template<typename T, typename Factor>
+struct Image_Scale_Op {
+	float max_in;
+	Factor max_out;
+	T operator()( const T& val ) const { return (T)((val / max_in) * max_out); }
+};
+
+template<typename T>
+struct Image_Clamp_Op {
+	T low;
+	T high;
+	T operator()( const T& val ) const { return std::min(std::max(val, low), high); }
+};
+
+
+// ###################################################################################################################
+// ############################################ OPERANDS #############################################################
+// ###################################################################################################################
+
+// An expression is kept as is, an image or a view becomes a terminal
+template<typename E>
+const E& to_expression( const Image_Expression<E>& expression ) {
+	return expression.self();
+}
+
+template<typename T, typename Allocator>
+Image_Terminal<T> to_expression( const Image3D<T, Allocator>& image ) {
+	return Image_Terminal<T>(image.view());
+}
+
+template<typename T>
+Image_Terminal<typename std::remove_const<T>::type> to_expression( const Image3DView<T>& view ) {
+	return Image_Terminal<typename std::remove_const<T>::type>(view);
+}
+
+template<typename X>
+using Image_Expression_Of = typename std::decay<decltype(to_expression(std::declval<const X&>()))>::type;
+
+template<typename X>
+using Image_Value_Of = typename Image_Expression_Of<X>::value_type;
+
+
+// ###################################################################################################################
+// ############################################ OPERATIONS ###########################################################
+// ###################################################################################################################
+
+template<typename X, typename Y>
+Image_Binary<Image_Expression_Of<X>, Image_Expression_Of<Y>, Image_Min_Op> expr_min( const X& a, const Y& b ) {
+	return { to_expression(a), to_expression(b) };
+}
+
+template<typename X, typename Y>
+Image_Binary<Image_Expression_Of<X>, Image_Expression_Of<Y>, Image_Max_Op> expr_max( const X& a, const Y& b ) {
+	return { to_expression(a), to_expression(b) };
+}
+
+// a - b, as diff() in Algo.hpp
+template<typename X, typename Y>
+Image_Binary<Image_Expression_Of<X>, Image_Expression_Of<Y>, Image_Diff_Op> expr_diff( const X& a, const Y& b ) {
+	return { to_expression(a), to_expression(b) };
+}
+
+// (a / max_in) * max_out, with a / max_in computed in float (at least)
+template<typename X, typename Factor>
+Image_Unary<Image_Expression_Of<X>, Image_Scale_Op<Image_Value_Of<X>, Factor>> expr_scale( const X& a, float max_in, Factor max_out ) {
+	return { to_expression(a), Image_Scale_Op<Image_Value_Of<X>, Factor>{ max_in, max_out } };
+}
+
+// a where mask (an image or a view) is not 0, 0 elsewhere, as mask_image() in Algo.hpp
+template<typename X, typename M>
+Image_Masked<Image_Expression_Of<X>, Image_Value_Of<M>> expr_mask( const X& a, const M& mask ) {
+	return { to_expression(a), to_expression(mask) };
+}
+
+// a clamped to [low, high]
+template<typename X>
+Image_Unary<Image_Expression_Of<X>, Image_Clamp_Op<Image_Value_Of<X>>> expr_clamp( const X& a, Image_Value_Of<X> low, Image_Value_Of<X> high ) {
+	return { to_expression(a), Image_Clamp_Op<Image_Value_Of<X>>{ low, high } };
+}
+
+
+// ###################################################################################################################
+// ############################################ EVALUATION ###########################################################
+// ###################################################################################################################
+
+// Compute expression in result, which is resized to the dimensions of the
+// first operand if needed. Contiguous operands are read with the SIMD
+// kernel of Image_Kernels.hpp, the others voxel by voxel.
+template<typename T, typename Allocator, typename E>
+void evaluate( Image3D<T, Allocator>& result, const Image_Expression<E>& expression ) {
+	static_assert(std::is_same<T, typename E::value_type>::value,
+		"Image_Expression: the result must have the type of the expression");
+
+	const E& e = expression.self();
+	const auto& geometry = e.geometry();
+
+	if (!e.same_dimensions(geometry)) {
+		std::cout << "Error in Image_Expression.hpp (evaluate): "
+			<< "Size of images is not the same." << std::endl;
+		return;
+	}
+
+	if (result.dimX() != geometry.dimX() || result.dimY() != geometry.dimY() || result.dimZ() != geometry.dimZ())
+		result = Image3D<T, Allocator>(geometry.dimX(), geometry.dimY(), geometry.dimZ(),
+			geometry.spacingX(), geometry.spacingY(), geometry.spacingZ(),
+			geometry.originX(), geometry.originY(), geometry.originZ(), uninitialized);
+
+	T* out = result.get_pointer();
+
+	if (e.contiguous()) {
+		parallel_simd_for(result.size(), [out, e](std::ptrdiff_t i) { out[i] = e.get(i); });
+		return;
+	}
+
+	const int dimX = result.dimX();
+	const int dimY = result.dimY();
+	const int dimZ = result.dimZ();
+
+	#pragma omp parallel for
+	for (int z = 0; z < dimZ; z++)
+		for (int y = 0; y < dimY; y++)
+			for (int x = 0; x < dimX; x++)
+				out[((std::ptrdiff_t) z * dimY + y) * dimX + x] = e.get(Voxel_Position{ x, y, z });
+}
+
+// New image computed from expression
+template<typename E>
+Image3D<typename E::value_type> evaluate( const Image_Expression<E>& expression ) {
+	Image3D<typename E::value_type> result;
+	evaluate(result, expression);
+	return result;
+}
+
+template<typename T, typename Allocator>
+template<typename E>
+Image3D<T, Allocator>& Image3D<T, Allocator>::operator =( const Image_Expression<E>& expression ) {
+	evaluate(*this, expression);
+	return *this;
+}
+
+#endif // IMAGE_EXPRESSION_INCLUDED
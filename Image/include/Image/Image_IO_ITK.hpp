@@ -34,9 +34,11 @@ odyssee.merveille@gmail.com
 
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
 #include <itkImportImageFilter.h>
+#include <itkUnaryFunctorImageFilter.h>
 #include <itkImageSeriesReader.h>
 #include <itkGDCMImageIO.h>
 #include <itkGDCMSeriesFileNames.h>
@@ -70,8 +72,32 @@ std::optional<Image3DMetadata> Read_Itk_Metadata(const std::string &image_path)
              imageIO->GetNumberOfDimensions()});
 }
 
+// Image read by ITK, seen through an Image3DView: the voxels stay in the
+// buffer of the ITK image, which is kept alive by this object.
 template<typename PixelType>
-Image3D<PixelType> Read_Itk_Image(const std::string& image_path)
+class Itk_Image3DView : public Image3DView<PixelType> {
+
+public :
+
+	typedef itk::Image<PixelType, 3> ITKImageType;
+
+	Itk_Image3DView() {}
+
+	Itk_Image3DView( const typename ITKImageType::Pointer& itkImage ):
+		Image3DView<PixelType>(itkImage->GetBufferPointer(),
+			itkImage->GetLargestPossibleRegion().GetSize()[0],
+			itkImage->GetLargestPossibleRegion().GetSize()[1],
+			itkImage->GetLargestPossibleRegion().GetSize()[2],
+			itkImage->GetSpacing()[0], itkImage->GetSpacing()[1], itkImage->GetSpacing()[2],
+			itkImage->GetOrigin()[0], itkImage->GetOrigin()[1], itkImage->GetOrigin()[2]),
+		m_itkImage(itkImage) {}
+
+	private :
+		typename ITKImageType::Pointer m_itkImage;
+};
+
+template<typename PixelType>
+Itk_Image3DView<PixelType> Read_Itk_Image_View(const std::string& image_path)
 {
 	typedef itk::Image<PixelType, 3> ITKImageType;
 
@@ -80,19 +106,17 @@ Image3D<PixelType> Read_Itk_Image(const std::string& image_path)
 	reader->SetFileName(image_path);
 	reader->Update();
 
-	typename ITKImageType::Pointer itkImage = reader->GetOutput();
-
-	const typename ITKImageType::SizeType& itkSize = itkImage->GetLargestPossibleRegion().GetSize();
-	auto spacing = itkImage->GetSpacing();
-	auto origin = itkImage->GetOrigin();
-	Image3D<PixelType> image(itkSize[0], itkSize[1], itkSize[2],spacing[0],spacing[1],spacing[2],origin[0],origin[1],origin[2]);
-    image.add_data_from_pointer(itkImage->GetBufferPointer());
+	return Itk_Image3DView<PixelType>(reader->GetOutput());
+}
 
-    return image;
+template<typename PixelType>
+Image3D<PixelType> Read_Itk_Image(const std::string& image_path)
+{
+	return Image3D<PixelType>::from_view(Read_Itk_Image_View<PixelType>(image_path));
 }
 
 template<typename PixelType>
-Image3D<PixelType> Read_Itk_Image_Series(const std::string& image_path)
+Itk_Image3DView<PixelType> Read_Itk_Image_Series_View(const std::string& image_path)
 {
 	typedef itk::Image<PixelType, 3> ITKImageType;
 
@@ -118,28 +142,26 @@ Image3D<PixelType> Read_Itk_Image_Series(const std::string& image_path)
 	catch( itk::ExceptionObject& ex )
 	{
 		std::cout << ex.GetDescription();
-		return Image3D<PixelType>();
+		return Itk_Image3DView<PixelType>();
 	}
 
-	const typename ITKImageType::Pointer& itkImage = reader->GetOutput();
-	const typename ITKImageType::SizeType& itkSize = itkImage->GetLargestPossibleRegion().GetSize();
-	auto spacing = itkImage->GetSpacing();
-	auto origin = itkImage->GetOrigin();
-	Image3D<PixelType> image(itkSize[0], itkSize[1], itkSize[2],spacing[0],spacing[1],spacing[2],origin[0],origin[1],origin[2]);
-
-
-    image.add_data_from_pointer(itkImage->GetBufferPointer());
+	return Itk_Image3DView<PixelType>(reader->GetOutput());
+}
 
-    return image;
+template<typename PixelType>
+Image3D<PixelType> Read_Itk_Image_Series(const std::string& image_path)
+{
+	Itk_Image3DView<PixelType> image = Read_Itk_Image_Series_View<PixelType>(image_path);
+	if (image.empty())
+		return Image3D<PixelType>();
+	return Image3D<PixelType>::from_view(image);
 }
 
 
+// ITK image on the buffer of image (the voxels are not copied)
 template<typename PixelType>
-void Write_Itk_Image( Image3D<PixelType>& image, const std::string& image_path )
+typename itk::ImportImageFilter<PixelType, 3>::Pointer Import_Itk_Image( Image3D<PixelType>& image )
 {
-	typedef itk::Image<PixelType, 3> ITKImageType;
-
-	// Convert image to ITK image
     typedef typename itk::ImportImageFilter<PixelType, 3> ImportImageFilterType;
     typename ImportImageFilterType::Pointer importFilter = ImportImageFilterType::New();
 
@@ -165,6 +187,17 @@ void Write_Itk_Image( Image3D<PixelType>& image, const std::string& image_path )
 	const bool importImageFilterWillOwnTheBuffer = false;
 	importFilter->SetImportPointer( image.get_pointer(), image.size(), importImageFilterWillOwnTheBuffer );
 
+	return importFilter;
+}
+
+template<typename PixelType>
+void Write_Itk_Image( Image3D<PixelType>& image, const std::string& image_path )
+{
+	typedef itk::Image<PixelType, 3> ITKImageType;
+
+	// Convert image to ITK image
+	typename itk::ImportImageFilter<PixelType, 3>::Pointer importFilter = Import_Itk_Image(image);
+
 	// Write ITK image
 	typedef itk::ImageFileWriter< ITKImageType  > WriterType;
 	typename WriterType::Pointer writer = WriterType::New();
@@ -173,4 +206,60 @@ void Write_Itk_Image( Image3D<PixelType>& image, const std::string& image_path )
 	writer->Update();
 }
 
+// (value - min) / (max - min), computed in double
+template<typename PixelType, typename OutputType>
+class Normalize_Functor {
+
+public :
+
+	Normalize_Functor(): m_min(0), m_range(1.0) {}
+
+	Normalize_Functor( PixelType min, PixelType max ): m_min(min), m_range((double) (max - min)) {}
+
+	bool operator !=( const Normalize_Functor& other ) const {
+		return m_min != other.m_min || m_range != other.m_range;
+	}
+
+	bool operator ==( const Normalize_Functor& other ) const {
+		return !(*this != other);
+	}
+
+	OutputType operator ()( const PixelType& value ) const {
+		return (OutputType) ((value - m_min) / m_range);
+	}
+
+	private :
+		PixelType m_min;
+		double m_range;
+};
+
+// Write image normalized from [min, max] to [0, 1] as OutputType (float or
+// double). The normalized values are computed by the writer's pipeline
+// (multithreaded by ITK), not stored in an intermediate Image3D<double>,
+// and written in pieces of about 256 MB when the file format allows it.
+template<typename OutputType, typename PixelType>
+void Write_Itk_Image_Normalized( Image3D<PixelType>& image, PixelType min, PixelType max, const std::string& image_path )
+{
+	typedef itk::Image<PixelType, 3> ITKImageType;
+	typedef itk::Image<OutputType, 3> ITKOutputImageType;
+	typedef Normalize_Functor<PixelType, OutputType> FunctorType;
+
+	typename itk::ImportImageFilter<PixelType, 3>::Pointer importFilter = Import_Itk_Image(image);
+
+	typedef itk::UnaryFunctorImageFilter<ITKImageType, ITKOutputImageType, FunctorType> NormalizeFilterType;
+	typename NormalizeFilterType::Pointer normalizeFilter = NormalizeFilterType::New();
+	normalizeFilter->SetFunctor(FunctorType(min, max));
+	normalizeFilter->SetInput(importFilter->GetOutput());
+
+	const std::size_t pieceBytes = (std::size_t) 256 << 20;
+	const std::size_t outputBytes = image.size() * sizeof(OutputType);
+
+	typedef itk::ImageFileWriter< ITKOutputImageType > WriterType;
+	typename WriterType::Pointer writer = WriterType::New();
+	writer->SetFileName( image_path );
+	writer->SetInput( normalizeFilter->GetOutput() );
+	writer->SetNumberOfStreamDivisions( (unsigned int) std::max<std::size_t>(1, (outputBytes + pieceBytes - 1) / pieceBytes) );
+	writer->Update();
+}
+
 #endif // Images_IO_ITK_INCLUDED
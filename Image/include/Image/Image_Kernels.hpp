@@ -0,0 +1,251 @@
+/* Copyright (C) 2014 Odyssee Merveille
+odyssee.merveille@gmail.com
+
+	This software is a computer program whose purpose is to compute RORPO.
+	This software is governed by the CeCILL-B license under French law and
+	abiding by the rules of distribution of free software.  You can  use,
+	modify and/ or redistribute the software under the terms of the CeCILL-B
+	license as circulated by CEA, CNRS and INRIA at the following URL
+	"http://www.cecill.info".
+
+	As a counterpart to the access to the source code and  rights to copy,
+	modify and redistribute granted by the license, users are provided only
+	with a limited warranty  and the software's author,  the holder of the
+	economic rights,  and the successive licensors  have only  limited
+	liability.
+
+	In this respect, the user's attention is drawn to the risks associated
+	with loading,  using,  modifying and/or developing or reproducing the
+	software by the user in light of its specific status of free software,
+	that may mean  that it is complicated to manipulate,  and  that  also
+	therefore means  that it is reserved for developers  and  experienced
+	professionals having in-depth computer knowledge. Users are therefore
+	encouraged to load and test the software's suitability as regards their
+	requirements in conditions enabling the security of their systems and/or
+	data to be ensured and,  more generally, to use and operate it in the
+	same conditions as regards security.
+
+	The fact that you are presently reading this means that you have had
+	knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#ifndef IMAGE_KERNELS_INCLUDED
+#define IMAGE_KERNELS_INCLUDED
+
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+
+// Elementwise kernels on the image buffers (diff, min/max, mask, windowing...).
+// They only stream the buffers, so they are written once as a "#pragma omp
+// simd" loop which is compiled for several instruction sets; the best one
+// supported by the processor is selected once, at the first call. Large
+// buffers are split in IMAGE_KERNEL_CHUNK elements shared by the OpenMP
+// threads.
+
+// Number of elements of the chunks given to the threads
+#define IMAGE_KERNEL_CHUNK (1 << 16)
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGE_KERNELS_X86
+#endif
+
+enum class SIMD_Level {
+	Scalar,
+	SSE2,
+	AVX2,
+	AVX512
+};
+
+
+// ###################################################################################################################
+// ############################################ SIMD DISPATCH ########################################################
+// ###################################################################################################################
+
+// Instruction set used by the kernels: the best one supported by the
+// processor, unless set_level() asks for a lower one (to compare them).
+class SIMD_Dispatch {
+
+public :
+
+	static SIMD_Dispatch& instance() {
+		static SIMD_Dispatch dispatch;
+		return dispatch;
+	}
+
+	SIMD_Level level() const {
+		return m_level;
+	}
+
+	// Best level supported by the processor
+	SIMD_Level supported() const {
+		return m_supported;
+	}
+
+	// Use "level", or the supported level if it is higher. Not to be called
+	// while kernels are running.
+	void set_level( SIMD_Level level ) {
+		m_level = std::min(level, m_supported);
+	}
+
+	const char* name() const {
+		switch (m_level) {
+			case SIMD_Level::AVX512: return "AVX-512";
+			case SIMD_Level::AVX2: return "AVX2";
+			case SIMD_Level::SSE2: return "SSE2";
+			default: return "scalar";
+		}
+	}
+
+	private :
+		SIMD_Dispatch(): m_supported(detect()), m_level(m_supported) {}
+
+		static SIMD_Level detect() {
+#ifdef IMAGE_KERNELS_X86
+			__builtin_cpu_init();
+			// 8 and 16 bits integers need AVX512BW
+			if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+				return SIMD_Level::AVX512;
+			if (__builtin_cpu_supports("avx2"))
+				return SIMD_Level::AVX2;
+			if (__builtin_cpu_supports("sse2"))
+				return SIMD_Level::SSE2;
+#endif
+			return SIMD_Level::Scalar;
+		}
+
+		SIMD_Level m_supported;
+		SIMD_Level m_level;
+};
+
+
+// ###################################################################################################################
+// ############################################ KERNEL BODIES ########################################################
+// ###################################################################################################################
+
+// f(i) for i in [begin, end)
+template<typename Function>
+inline void simd_loop( Function& f, std::ptrdiff_t begin, std::ptrdiff_t end ) {
+	#pragma omp simd
+	for (std::ptrdiff_t i = begin; i < end; i++)
+		f(i);
+}
+
+// Minimum and maximum of data[begin, end), merged in minimum and maximum
+template<typename T>
+inline void simd_min_max( const T* data, std::ptrdiff_t begin, std::ptrdiff_t end, T& minimum, T& maximum ) {
+	T lo = minimum;
+	T hi = maximum;
+	#pragma omp simd reduction(min:lo) reduction(max:hi)
+	for (std::ptrdiff_t i = begin; i < end; i++) {
+		lo = data[i] < lo ? data[i] : lo;
+		hi = hi < data[i] ? data[i] : hi;
+	}
+	minimum = lo;
+	maximum = hi;
+}
+
+// f(i) for i in [begin, end), maximum of the values returned by f merged in maximum
+template<typename T, typename Function>
+inline void simd_loop_max( Function& f, std::ptrdiff_t begin, std::ptrdiff_t end, T& maximum ) {
+	T hi = maximum;
+	#pragma omp simd reduction(max:hi)
+	for (std::ptrdiff_t i = begin; i < end; i++) {
+		const T val = f(i);
+		hi = hi < val ? val : hi;
+	}
+	maximum = hi;
+}
+
+// Versions of a kernel body compiled for each instruction set. flatten
+// inlines the body (and the function it applies) in each version.
+#ifdef IMAGE_KERNELS_X86
+#define IMAGE_KERNEL_VERSION(body, suffix, isa) \
+	template<typename... Args> \
+	__attribute__((target(isa), flatten)) void body##_##suffix( Args&&... args ) { \
+		body(std::forward<Args>(args)...); \
+	}
+
+#define IMAGE_KERNEL_VERSIONS(body) \
+	IMAGE_KERNEL_VERSION(body, sse2, "sse2") \
+	IMAGE_KERNEL_VERSION(body, avx2, "avx2") \
+	IMAGE_KERNEL_VERSION(body, avx512, "avx512f,avx512bw")
+
+#define IMAGE_KERNEL_DISPATCH(body, ...) \
+	switch (SIMD_Dispatch::instance().level()) { \
+		case SIMD_Level::AVX512: body##_avx512(__VA_ARGS__); break; \
+		case SIMD_Level::AVX2: body##_avx2(__VA_ARGS__); break; \
+		case SIMD_Level::SSE2: body##_sse2(__VA_ARGS__); break; \
+		default: body(__VA_ARGS__); \
+	}
+
+IMAGE_KERNEL_VERSIONS(simd_loop)
+IMAGE_KERNEL_VERSIONS(simd_min_max)
+IMAGE_KERNEL_VERSIONS(simd_loop_max)
+#else
+#define IMAGE_KERNEL_DISPATCH(body, ...) body(__VA_ARGS__);
+#endif
+
+
+// ###################################################################################################################
+// ############################################ KERNELS ##############################################################
+// ###################################################################################################################
+
+// f(i) for i in [0, n), f being applied to independent elements. Used with
+// the pointers of contiguous buffers, e.g. f = [=](std::ptrdiff_t i) { r[i] = a[i] - b[i]; }
+template<typename Function>
+void parallel_simd_for( std::size_t n, Function f ) {
+	const std::ptrdiff_t size = (std::ptrdiff_t) n;
+	const std::ptrdiff_t chunks = (size + IMAGE_KERNEL_CHUNK - 1) / IMAGE_KERNEL_CHUNK;
+
+	#pragma omp parallel for schedule(static) if (chunks > 1)
+	for (std::ptrdiff_t c = 0; c < chunks; c++) {
+		const std::ptrdiff_t begin = c * IMAGE_KERNEL_CHUNK;
+		const std::ptrdiff_t end = std::min(begin + IMAGE_KERNEL_CHUNK, size);
+		IMAGE_KERNEL_DISPATCH(simd_loop, f, begin, end)
+	}
+}
+
+// f(i) for i in [0, n) as parallel_simd_for, f returning a value of type T;
+// return the maximum of these values and "initial"
+template<typename T, typename Function>
+T parallel_simd_for_max( std::size_t n, T initial, Function f ) {
+	const std::ptrdiff_t size = (std::ptrdiff_t) n;
+	const std::ptrdiff_t chunks = (size + IMAGE_KERNEL_CHUNK - 1) / IMAGE_KERNEL_CHUNK;
+
+	T maximum = initial;
+
+	#pragma omp parallel for schedule(static) reduction(max:maximum) if (chunks > 1)
+	for (std::ptrdiff_t c = 0; c < chunks; c++) {
+		const std::ptrdiff_t begin = c * IMAGE_KERNEL_CHUNK;
+		const std::ptrdiff_t end = std::min(begin + IMAGE_KERNEL_CHUNK, size);
+		T hi = initial;
+		IMAGE_KERNEL_DISPATCH(simd_loop_max, f, begin, end, hi)
+		maximum = std::max(maximum, hi);
+	}
+	return maximum;
+}
+
+// Minimum and maximum of data[0, n), n > 0
+template<typename T>
+std::pair<T,T> parallel_min_max( const T* data, std::size_t n ) {
+	const std::ptrdiff_t size = (std::ptrdiff_t) n;
+	const std::ptrdiff_t chunks = (size + IMAGE_KERNEL_CHUNK - 1) / IMAGE_KERNEL_CHUNK;
+
+	T minimum = data[0];
+	T maximum = data[0];
+
+	#pragma omp parallel for schedule(static) reduction(min:minimum) reduction(max:maximum) if (chunks > 1)
+	for (std::ptrdiff_t c = 0; c < chunks; c++) {
+		const std::ptrdiff_t begin = c * IMAGE_KERNEL_CHUNK;
+		const std::ptrdiff_t end = std::min(begin + IMAGE_KERNEL_CHUNK, size);
+		T lo = data[begin];
+		T hi = data[begin];
+		IMAGE_KERNEL_DISPATCH(simd_min_max, data, begin, end, lo, hi)
+		minimum = std::min(minimum, lo);
+		maximum = std::max(maximum, hi);
+	}
+	return { minimum, maximum };
+}
+
+#endif // IMAGE_KERNELS_INCLUDED
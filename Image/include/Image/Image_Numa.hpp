@@ -0,0 +1,205 @@
+/* Copyright (C) 2014 Odyssee Merveille
+odyssee.merveille@gmail.com
+
+	This software is a computer program whose purpose is to compute RORPO.
+	This software is governed by the CeCILL-B license under French law and
+	abiding by the rules of distribution of free software.  You can  use,
+	modify and/ or redistribute the software under the terms of the CeCILL-B
+	license as circulated by CEA, CNRS and INRIA at the following URL
+	"http://www.cecill.info".
+
+	As a counterpart to the access to the source code and  rights to copy,
+	modify and redistribute granted by the license, users are provided only
+	with a limited warranty  and the software's author,  the holder of the
+	economic rights,  and the successive licensors  have only  limited
+	liability.
+
+	In this respect, the user's attention is drawn to the risks associated
+	with loading,  using,  modifying and/or developing or reproducing the
+	software by the user in light of its specific status of free software,
+	that may mean  that it is complicated to manipulate,  and  that  also
+	therefore means  that it is reserved for developers  and  experienced
+	professionals having in-depth computer knowledge. Users are therefore
+	encouraged to load and test the software's suitability as regards their
+	requirements in conditions enabling the security of their systems and/or
+	data to be ensured and,  more generally, to use and operate it in the
+	same conditions as regards security.
+
+	The fact that you are presently reading this means that you have had
+	knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#ifndef IMAGE_NUMA_INCLUDED
+#define IMAGE_NUMA_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef RORPO_NUMA
+#include <cstdlib>
+#include <cstring>
+#include <numa.h>
+#include <numaif.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+
+// ###################################################################################################################
+// ############################################ NUMA PLACEMENT #######################################################
+// ###################################################################################################################
+
+// Placement of the buffers and of the threads on the nodes of a multi-socket
+// machine, built with RORPO_NUMA (libnuma). It is enabled when the machine
+// has several nodes, unless enable(false) is called (to compare), or on a
+// single node with the environment variable RORPO_NUMA_FORCE=1 (to test).
+// Otherwise every function is a no-op and the whole machine is node 0.
+// - the shared read-only buffers are interleaved across the nodes
+// - Task_Graph pins the workers running serial stages on the cpus of one
+//   node (worker w on node w % nodes()) among those they were allowed to run
+//   on, so that the per-task buffers are first-touched, and then read, on
+//   that node, and gives them their affinity back afterwards
+// - Image_Buffer_Pool hands back buffers lying on the node of the caller
+class Numa_Placement {
+
+public :
+
+	static Numa_Placement& instance() {
+		static Numa_Placement placement;
+		return placement;
+	}
+
+	// Built with RORPO_NUMA on a machine of several nodes, or forced
+	bool available() const {
+		return m_nNodes > 1 || m_forced;
+	}
+
+	bool enabled() const {
+		return m_enabled;
+	}
+
+	// Not to be called while RORPO is running
+	void enable( bool enabled = true ) {
+		m_enabled = enabled && available();
+	}
+
+	int nodes() const {
+		return m_nNodes;
+	}
+
+	// Node of the cpu running the calling thread
+	int current_node() const {
+#ifdef RORPO_NUMA
+		if (m_enabled) {
+			const int cpu = sched_getcpu();
+			return cpu < 0 ? 0 : std::max(0, numa_node_of_cpu(cpu));
+		}
+#endif
+		return 0;
+	}
+
+	// Node of the page holding "address" (0 if it was never touched)
+	int node_of( const void* address ) const {
+#ifdef RORPO_NUMA
+		if (m_enabled) {
+			int node = 0;
+			if (get_mempolicy(&node, nullptr, 0, const_cast<void*>(address), MPOL_F_NODE | MPOL_F_ADDR) == 0)
+				return node;
+		}
+#else
+		(void) address;
+#endif
+		return 0;
+	}
+
+	// Interleave the pages of [address, address + bytes) across the nodes,
+	// the pages already touched being moved
+	void interleave( const void* address, std::size_t bytes ) const {
+#ifdef RORPO_NUMA
+		if (!m_enabled)
+			return;
+		// Whole pages inside the buffer only
+		const std::uintptr_t page = (std::uintptr_t) sysconf(_SC_PAGESIZE);
+		const std::uintptr_t begin = ((std::uintptr_t) address + page - 1) / page * page;
+		const std::uintptr_t end = ((std::uintptr_t) address + bytes) / page * page;
+		if (end > begin)
+			mbind((void*) begin, end - begin, MPOL_INTERLEAVE, numa_all_nodes_ptr->maskp,
+				  numa_all_nodes_ptr->size + 1, MPOL_MF_MOVE);
+#else
+		(void) address;
+		(void) bytes;
+#endif
+	}
+
+	// Run the calling thread on the cpus of node "worker % nodes()" it is
+	// allowed to run on (all of them if there is none), its affinity being
+	// saved by the first call
+	void pin_worker( int worker ) const {
+#ifdef RORPO_NUMA
+		if (!m_enabled)
+			return;
+		Saved_Affinity &saved = saved_affinity();
+		if (!saved.valid) {
+			if (sched_getaffinity(0, sizeof(cpu_set_t), &saved.cpus) != 0)
+				return;
+			saved.valid = true;
+		}
+		const int node = worker % m_nNodes;
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		for (int cpu = 0; cpu < (int) m_vNodeOfCpu.size() && cpu < CPU_SETSIZE; ++cpu)
+			if (m_vNodeOfCpu[cpu] == node && CPU_ISSET(cpu, &saved.cpus))
+				CPU_SET(cpu, &cpus);
+		sched_setaffinity(0, sizeof(cpu_set_t), CPU_COUNT(&cpus) > 0 ? &cpus : &saved.cpus);
+#else
+		(void) worker;
+#endif
+	}
+
+	// Give the calling thread back the affinity saved by pin_worker
+	void unpin() const {
+#ifdef RORPO_NUMA
+		Saved_Affinity &saved = saved_affinity();
+		if (saved.valid) {
+			sched_setaffinity(0, sizeof(cpu_set_t), &saved.cpus);
+			saved.valid = false;
+		}
+#endif
+	}
+
+	private :
+		Numa_Placement(): m_nNodes(1), m_enabled(false), m_forced(false) {
+#ifdef RORPO_NUMA
+			if (numa_available() >= 0) {
+				m_nNodes = numa_num_configured_nodes();
+				const char* force = std::getenv("RORPO_NUMA_FORCE");
+				m_forced = force && std::strcmp(force, "1") == 0;
+				for (int cpu = 0; cpu < numa_num_configured_cpus(); ++cpu)
+					m_vNodeOfCpu.push_back(numa_node_of_cpu(cpu));
+			}
+			m_enabled = available();
+#endif
+		}
+
+#ifdef RORPO_NUMA
+		// Affinity of a thread before its first pin_worker
+		struct Saved_Affinity {
+			cpu_set_t cpus;
+			bool valid = false;
+		};
+
+		static Saved_Affinity& saved_affinity() {
+			thread_local Saved_Affinity saved;
+			return saved;
+		}
+#endif
+
+		int m_nNodes;
+		bool m_enabled;
+		bool m_forced;
+		std::vector<int> m_vNodeOfCpu;
+};
+
+#endif // IMAGE_NUMA_INCLUDED
@@ -64,50 +64,32 @@ std::vector<std::string> split(std::string str, char delimiter) {
   return internal;
 }
 
+// Write multiscale normalized to [0,1], as float or double (doubleOutput)
 template<typename PixelType>
-void normalize_and_write_output(std::string outputPath, bool verbose, Image3D<PixelType> multiscale) {
+void normalize_and_write_output(std::string outputPath, bool verbose, bool doubleOutput, Image3D<PixelType> &multiscale) {
 
     // getting min and max from multiscale image
-    PixelType min = 255;
-    PixelType max = 0;
-
-    for (auto value: multiscale.get_data()) {
-        if (value > max)
-            max = value;
-        if (value < min)
-            min = value;
-    }
-
-    // normalize output
-    Image3D<double> multiscale_normalized(multiscale.dimX(),
-                                         multiscale.dimY(),
-                                         multiscale.dimZ(),
-                                         multiscale.spacingX(),
-                                         multiscale.spacingY(),
-                                         multiscale.spacingZ(),
-                                         multiscale.originX(),
-                                         multiscale.originY(),
-                                         multiscale.originZ()
-    );
+    std::pair<PixelType,PixelType> minmax = multiscale.min_max_value();
+    PixelType min = minmax.first;
+    PixelType max = minmax.second;
 
     if (max - min == 0)
         max = min + 1;
 
-    for (unsigned int i = 0; i < multiscale.size(); i++) {
-        multiscale_normalized.get_data()[i] = (multiscale.get_data()[i] - min) / (double) (max - min);
-    }
-
     if (verbose) {
         std::cout << "converting output image intensity : " << (int) min << "-" << (int) max << " to [0,1]"
                   << std::endl;
     }
 
-    // Write the result to nifti image
-    Write_Itk_Image<double>(multiscale_normalized, outputPath);
+    // Normalize and write the result to nifti image, in a single pass
+    if (doubleOutput)
+        Write_Itk_Image_Normalized<double>(multiscale, min, max, outputPath);
+    else
+        Write_Itk_Image_Normalized<float>(multiscale, min, max, outputPath);
 }
 
 template<typename PixelType>
-int RORPO_multiscale_usage(Image3D<PixelType> &image,
+int RORPO_multiscale_usage(Image3DView<PixelType> &image,
                            std::string outputVolume,
                            std::vector<int> &scaleList,
                            std::vector<int> &window,
@@ -115,7 +97,14 @@ int RORPO_multiscale_usage(Image3D<PixelType> &image,
                            int dilationSize,
                            bool verbose,
                            bool normalize,
+                           bool normalizeDouble,
+                           int memoryBudget,
                            std::string maskVolume) {
+    if (image.empty()) {
+        std::cerr << "Error: input image is empty" << std::endl;
+        return 1;
+    }
+
     unsigned int dimz = image.dimZ();
     unsigned int dimy = image.dimY();
     unsigned int dimx= image.dimX();
@@ -148,11 +137,11 @@ int RORPO_multiscale_usage(Image3D<PixelType> &image,
 
     // -------------------------- mask Image -----------------------------------
 
-    Image3D<uint8_t> mask;
+    Itk_Image3DView<uint8_t> mask;
 
     if (!maskVolume.empty()) // A mask image is given
 	{
-        mask = Read_Itk_Image<uint8_t>(maskVolume);
+        mask = Read_Itk_Image_View<uint8_t>(maskVolume);
 
         if (mask.dimX() != dimx || mask.dimY() != dimy || mask.dimZ() != dimz){
             std::cerr<<"Size of the mask image (dimx= "<<mask.dimX()
@@ -179,14 +168,13 @@ int RORPO_multiscale_usage(Image3D<PixelType> &image,
             std::cout<<window[0]<<", "<<window[1]<<"]"<<std::endl;
         }
 
-        image.window_dynamic(window[0], window[1]);
-
         if(verbose)
             std::cout << "Convert image to uint8" << std::endl;
 
+        // Windowing and conversion in a single pass
         minmax.first = 0;
         minmax.second = 255;
-        Image3D<uint8_t> imageChar = image.copy_image_2_uchar();
+        Image3D<uint8_t> imageChar = image.copy_image_window_2_uchar(window[0], window[1]);
 
         // Run RORPO multiscale
         Image3D<uint8_t> multiscale =
@@ -195,9 +183,14 @@ int RORPO_multiscale_usage(Image3D<PixelType> &image,
                                                    nbCores,
                                                    dilationSize,
                                                    verbose,
-                                                   mask);
+                                                   mask,
+                                                   PO_Layout::Linear,
+                                                   nullptr,
+                                                   nullptr,
+                                                   Directions_Domain(),
+                                                   (std::size_t) memoryBudget << 20);
         if (normalize)
-            normalize_and_write_output<uint8_t>(outputVolume, verbose, multiscale);
+            normalize_and_write_output<uint8_t>(outputVolume, verbose, normalizeDouble, multiscale);
         else
             Write_Itk_Image<uint8_t>(multiscale, outputVolume);
     }
@@ -213,11 +206,16 @@ int RORPO_multiscale_usage(Image3D<PixelType> &image,
                                                      nbCores,
                                                      dilationSize,
                                                      verbose,
-                                                     mask);
+                                                     mask,
+                                                     PO_Layout::Linear,
+                                                     nullptr,
+                                                     nullptr,
+                                                     Directions_Domain(),
+                                                     (std::size_t) memoryBudget << 20);
 
         // normalize output
         if (normalize)
-            normalize_and_write_output(outputVolume, verbose, multiscale);
+            normalize_and_write_output(outputVolume, verbose, normalizeDouble, multiscale);
         else
             Write_Itk_Image<PixelType>(multiscale, outputVolume);
     }
@@ -233,11 +231,15 @@ static const char USAGE[] =
 R"(RORPO_multiscale_usage.
 
     USAGE:
-    RORPO_multiscale_usage --input=ImagePath --output=OutputPath --scaleMin=MinScale --factor=F --nbScales=NBS [--window=min,max] [--nbCores=nbCores] [--dilationSize=Size] [--mask=maskVolume] [--verbose] [--normalize] [--uint8] [--series]
+    RORPO_multiscale_usage --input=ImagePath --output=OutputPath --scaleMin=MinScale --factor=F --nbScales=NBS [--window=min,max] [--nbCores=nbCores] [--dilationSize=Size] [--mask=maskVolume] [--memoryBudget=MB] [--verbose] [--normalize] [--normalizeDouble] [--uint8] [--series]
 
     Options:
          --nbCores=<nbCores>      Number of CPUs used for RPO computation \
          --dilationSize=<Size> Size of the dilation for the noise robustness step \
+         --memoryBudget=MB     Compute several scales at the same time, as many \
+                               as fit in MB megabytes and leave 7 of the \
+                               nbCores CPUs to each scale (default: one \
+                               scale at a time).
          --window=min,max      Convert intensity range [min, max] of the input \
                                image to [0,255] and convert to uint8 image\
                                (strongly decrease computation time).
@@ -246,7 +248,8 @@ R"(RORPO_multiscale_usage.
                                mask image type must be uint8.
          --verbose             Activation of a verbose mode.
          --dicom               Specify that <imagePath> is a DICOM image.
-         --normalize           Return a double normalized output image
+         --normalize           Return a float normalized output image
+         --normalizeDouble     With --normalize, return a double output image
          --uint8               Convert input image into uint8.
         )";
 #endif
@@ -277,19 +280,24 @@ int main(int argc, char **argv) {
     std::vector<int> window(3);
     int nbCores = 1;
     int dilationSize = 3;
+    int memoryBudget = 0;
     std::string maskVolume;
     bool verbose = args["--verbose"].asBool();
     bool normalize = args["--normalize"].asBool();
+    bool normalizeDouble = args["--normalizeDouble"].asBool();
     
     if (args["--mask"])
         maskVolume = args["--mask"].asString();
 
-    if (args["--core"])
-        nbCores = std::stoi(args["--core"].asString());
+    if (args["--nbCores"])
+        nbCores = std::stoi(args["--nbCores"].asString());
 
     if(args["--dilationSize"])
         dilationSize = std::stoi(args["--dilationSize"].asString());
 
+    if(args["--memoryBudget"])
+        memoryBudget = std::stoi(args["--memoryBudget"].asString());
+
     if(verbose)
         std::cout<<"dilation size:"<<dilationSize<<std::endl;
 
@@ -306,6 +314,11 @@ int main(int argc, char **argv) {
         window[2] = 0; // --window not used
     #endif
 
+    if (memoryBudget < 0) {
+        std::cerr << "Error: memory budget is " << memoryBudget << " MB but should be positive or 0" << std::endl;
+        return 1;
+    }
+
     // -------------------------- Scales computation ---------------------------
 
     std::vector<int> scaleList(nbScales);
@@ -345,7 +358,7 @@ int main(int argc, char **argv) {
     switch (imageMetadata.pixelType){
         case itk::ImageIOBase::UCHAR:
         {
-            Image3D<unsigned char> image = dicom?Read_Itk_Image_Series<unsigned char>(inputVolume):Read_Itk_Image<unsigned char>(inputVolume);
+            Itk_Image3DView<unsigned char> image = dicom?Read_Itk_Image_Series_View<unsigned char>(inputVolume):Read_Itk_Image_View<unsigned char>(inputVolume);
             error = RORPO_multiscale_usage<unsigned char>(image,
                                                           outputVolume,
                                                           scaleList,
@@ -354,12 +367,14 @@ int main(int argc, char **argv) {
                                                           dilationSize,
                                                           verbose,
                                                           normalize,
+                                                          normalizeDouble,
+                                                          memoryBudget,
                                                           maskVolume);
             break;
         }
         case itk::ImageIOBase::CHAR:
         {
-            Image3D<char> image = dicom?Read_Itk_Image_Series<char>(inputVolume):Read_Itk_Image<char>(inputVolume);
+            Itk_Image3DView<char> image = dicom?Read_Itk_Image_Series_View<char>(inputVolume):Read_Itk_Image_View<char>(inputVolume);
             error = RORPO_multiscale_usage<char>(image,
                                                  outputVolume,
                                                  scaleList,
@@ -368,12 +383,14 @@ int main(int argc, char **argv) {
                                                  dilationSize,
                                                  verbose,
                                                  normalize,
+                                                 normalizeDouble,
+                                                 memoryBudget,
                                                  maskVolume);
             break;
         }
         case itk::ImageIOBase::USHORT:
         {
-            Image3D<unsigned short> image = dicom?Read_Itk_Image_Series<unsigned short>(inputVolume):Read_Itk_Image<unsigned short>(inputVolume);
+            Itk_Image3DView<unsigned short> image = dicom?Read_Itk_Image_Series_View<unsigned short>(inputVolume):Read_Itk_Image_View<unsigned short>(inputVolume);
             error = RORPO_multiscale_usage<unsigned short>(image,
                                                            outputVolume,
                                                            scaleList,
@@ -382,12 +399,14 @@ int main(int argc, char **argv) {
                                                            dilationSize,
                                                            verbose,
                                                            normalize,
+                                                           normalizeDouble,
+                                                           memoryBudget,
                                                            maskVolume);
             break;
         }
         case itk::ImageIOBase::SHORT:
         {
-            Image3D<short> image = dicom?Read_Itk_Image_Series<short>(inputVolume):Read_Itk_Image<short>(inputVolume);
+            Itk_Image3DView<short> image = dicom?Read_Itk_Image_Series_View<short>(inputVolume):Read_Itk_Image_View<short>(inputVolume);
             error = RORPO_multiscale_usage<short>(image,
                                                   outputVolume,
                                                   scaleList,
@@ -396,12 +415,14 @@ int main(int argc, char **argv) {
                                                   dilationSize,
                                                   verbose,
                                                   normalize,
+                                                  normalizeDouble,
+                                                  memoryBudget,
                                                   maskVolume);
             break;
         }
         case itk::ImageIOBase::UINT:
         {
-            Image3D<unsigned int> image = dicom?Read_Itk_Image_Series<unsigned int>(inputVolume):Read_Itk_Image<unsigned int>(inputVolume);
+            Itk_Image3DView<unsigned int> image = dicom?Read_Itk_Image_Series_View<unsigned int>(inputVolume):Read_Itk_Image_View<unsigned int>(inputVolume);
             error = RORPO_multiscale_usage<unsigned int>(image,
                                                          outputVolume,
                                                          scaleList,
@@ -410,12 +431,14 @@ int main(int argc, char **argv) {
                                                          dilationSize,
                                                          verbose,
                                                          normalize,
+                                                         normalizeDouble,
+                                                         memoryBudget,
                                                          maskVolume);
             break;
         }
         case itk::ImageIOBase::INT:
         {
-            Image3D<int> image = dicom?Read_Itk_Image_Series<int>(inputVolume):Read_Itk_Image<int>(inputVolume);
+            Itk_Image3DView<int> image = dicom?Read_Itk_Image_Series_View<int>(inputVolume):Read_Itk_Image_View<int>(inputVolume);
             error = RORPO_multiscale_usage<int>(image,
                                                 outputVolume,
                                                 scaleList,
@@ -424,12 +447,14 @@ int main(int argc, char **argv) {
                                                 dilationSize,
                                                 verbose,
                                                 normalize,
+                                                normalizeDouble,
+                                                memoryBudget,
                                                 maskVolume);
             break;
         }
         case itk::ImageIOBase::ULONG:
         {
-            Image3D<unsigned long> image = dicom?Read_Itk_Image_Series<unsigned long>(inputVolume):Read_Itk_Image<unsigned long>(inputVolume);
+            Itk_Image3DView<unsigned long> image = dicom?Read_Itk_Image_Series_View<unsigned long>(inputVolume):Read_Itk_Image_View<unsigned long>(inputVolume);
             error = RORPO_multiscale_usage<unsigned long>(image,
                                                           outputVolume,
                                                           scaleList,
@@ -438,12 +463,14 @@ int main(int argc, char **argv) {
                                                           dilationSize,
                                                           verbose,
                                                           normalize,
+                                                          normalizeDouble,
+                                                          memoryBudget,
                                                           maskVolume);
             break;
         }
         case itk::ImageIOBase::LONG:
         {
-            Image3D<long> image = dicom?Read_Itk_Image_Series<long>(inputVolume):Read_Itk_Image<long>(inputVolume);
+            Itk_Image3DView<long> image = dicom?Read_Itk_Image_Series_View<long>(inputVolume):Read_Itk_Image_View<long>(inputVolume);
             error = RORPO_multiscale_usage<long>(image,
                                                  outputVolume,
                                                  scaleList,
@@ -452,13 +479,15 @@ int main(int argc, char **argv) {
                                                  dilationSize,
                                                  verbose,
                                                  normalize,
+                                                 normalizeDouble,
+                                                 memoryBudget,
                                                  maskVolume);
             break;
         }
 #ifdef ITK_SUPPORTS_LONGLONG
 	case itk::ImageIOBase::ULONGLONG:
         {
-            Image3D<unsigned long long> image = dicom?Read_Itk_Image_Series<unsigned long long>(inputVolume):Read_Itk_Image<unsigned long long>(inputVolume);
+            Itk_Image3DView<unsigned long long> image = dicom?Read_Itk_Image_Series_View<unsigned long long>(inputVolume):Read_Itk_Image_View<unsigned long long>(inputVolume);
             error = RORPO_multiscale_usage<unsigned long long>(image,
                                                                outputVolume,
                                                                scaleList,
@@ -467,12 +496,14 @@ int main(int argc, char **argv) {
                                                                dilationSize,
                                                                verbose,
                                                                normalize,
+                                                               normalizeDouble,
+                                                               memoryBudget,
                                                                maskVolume);
             break;
         }
         case itk::ImageIOBase::LONGLONG:
         {
-            Image3D<long long> image = dicom?Read_Itk_Image_Series<long long>(inputVolume):Read_Itk_Image<long long>(inputVolume);
+            Itk_Image3DView<long long> image = dicom?Read_Itk_Image_Series_View<long long>(inputVolume):Read_Itk_Image_View<long long>(inputVolume);
             error = RORPO_multiscale_usage<long long>(image,
                                                       outputVolume,
                                                       scaleList,
@@ -481,13 +512,15 @@ int main(int argc, char **argv) {
                                                       dilationSize,
                                                       verbose,
                                                       normalize,
+                                                      normalizeDouble,
+                                                      memoryBudget,
                                                       maskVolume);
             break;
         }
 #endif // ITK_SUPPORTS_LONGLONG
         case itk::ImageIOBase::FLOAT:
         {
-            Image3D<float> image = dicom?Read_Itk_Image_Series<float>(inputVolume):Read_Itk_Image<float>(inputVolume);
+            Itk_Image3DView<float> image = dicom?Read_Itk_Image_Series_View<float>(inputVolume):Read_Itk_Image_View<float>(inputVolume);
             error = RORPO_multiscale_usage<float>(image,
                                                   outputVolume,
                                                   scaleList,
@@ -496,12 +529,14 @@ int main(int argc, char **argv) {
                                                   dilationSize,
                                                   verbose,
                                                   normalize,
+                                                  normalizeDouble,
+                                                  memoryBudget,
                                                   maskVolume);
             break;
         }
         case itk::ImageIOBase::DOUBLE:
         {
-            Image3D<double> image = dicom?Read_Itk_Image_Series<double>(inputVolume):Read_Itk_Image<double>(inputVolume);
+            Itk_Image3DView<double> image = dicom?Read_Itk_Image_Series_View<double>(inputVolume):Read_Itk_Image_View<double>(inputVolume);
             error = RORPO_multiscale_usage<double>(image,
                                                    outputVolume,
                                                    scaleList,
@@ -510,6 +545,8 @@ int main(int argc, char **argv) {
                                                    dilationSize,
                                                    verbose,
                                                    normalize,
+                                                   normalizeDouble,
+                                                   memoryBudget,
                                                    maskVolume);
             break;
         }
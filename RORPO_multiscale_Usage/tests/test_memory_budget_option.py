@@ -0,0 +1,61 @@
+import subprocess
+import glob
+import uuid
+import os
+import re
+import numpy as np
+from .generic_test import TestGeneric
+import nibabel as nib
+
+
+class TestMemoryBudgetOption(TestGeneric):
+    error_pattern = re.compile(r'(?i)(memory budget is -?[0-9]+ MB but should be positive or 0)')
+    # A scale runs 7 Path Openings: the budget can only compute several of
+    # the nb_scales scales at the same time with 7 threads per scale
+    nb_scales = 3
+    nb_cores = 7 * nb_scales
+
+    def run_rorpo(self, path, options):
+        output_path = os.path.join(self.BUILD_DIR, self.output + str(uuid.uuid4()) + ".nii")
+        args = [self.bin, "--input=" + path, "--output=" + output_path, "--scaleMin=3",
+                "--factor=1.5", "--nbScales=" + str(self.nb_scales),
+                "--nbCores=" + str(self.nb_cores)] + options
+        proc = subprocess.Popen(args, stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        outs, errs = proc.communicate(timeout=60)
+        return proc, output_path, str(outs), str(errs)
+
+    def test_memory_budget(self):
+        for path in glob.glob(self.SRC_DIR + '/data/positive*.nii'):
+            results = []
+            for options in [[], ['--memoryBudget=4096']]:
+                proc, output_path, outs, errs = self.run_rorpo(path, options)
+
+                # check return value is 0
+                assert (proc.returncode == 0)
+
+                # check if file exists
+                assert(os.path.exists(output_path))
+
+                img = nib.load(output_path)
+                results.append(np.asarray(img.dataobj).copy())
+
+                # remove generated output image
+                os.remove(output_path)
+
+            # check that computing the scales at the same time gives the same output
+            assert (results[0].dtype == results[1].dtype)
+            assert (np.array_equal(results[0], results[1]))
+
+    def test_negative_memory_budget(self):
+        for path in glob.glob(self.SRC_DIR + '/data/positive*.nii'):
+            proc, output_path, outs, errs = self.run_rorpo(path, ['--memoryBudget=-1'])
+
+            # check return value is 1
+            assert (proc.returncode == 1)
+
+            # check if file does not exist
+            assert(not os.path.exists(output_path))
+
+            # check if program generate expected messages
+            assert ("computation" not in outs)
+            assert (self.error_pattern.search(errs) is not None)
@@ -12,10 +12,16 @@ class TestNormalizeOption(TestGeneric):
     pattern = re.compile(r'(?i)(converting output image intensity\s*:\s*([0-9]*\s*-?\s*)*to \[0,1\])')
 
     def test_normalize(self):
+        self.check_normalize(['--normalize'], np.float32)
+
+    def test_normalize_double(self):
+        self.check_normalize(['--normalize', '--normalizeDouble'], np.float64)
+
+    def check_normalize(self, options, dtype):
         for path in glob.glob(self.SRC_DIR + '/data/positive*.nii'):
             output_path = os.path.join(self.BUILD_DIR, self.output + str(uuid.uuid4()) + ".nii")
             args = [self.bin, "--input=" + path, "--output=" + output_path, "--scaleMin=40",
-                    "--factor=1.32", "--nbScales=1", "--verbose", '--normalize']
+                    "--factor=1.32", "--nbScales=1", "--verbose"] + options
             proc = subprocess.Popen(args, stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
             outs, errs = proc.communicate(timeout=15)
 
@@ -25,9 +31,9 @@ class TestNormalizeOption(TestGeneric):
             # check if file exists
             assert(os.path.exists(output_path))
 
-            # check type of output image is double
+            # check type of output image
             img = nib.load(output_path)
-            assert(img.header.get_data_dtype() == np.dtype(np.float64))
+            assert(img.header.get_data_dtype() == np.dtype(dtype))
 
             # check that output image is normalized
             data = img.get_fdata()
@@ -33,6 +33,7 @@ odyssee.merveille@gmail.com
 #define ALGO_INCLUDED
 
 #include <stdlib.h>
+#include <cmath>
 #include <iostream>
 #include <string>
 
@@ -43,71 +44,88 @@ odyssee.merveille@gmail.com
 template<typename T>
 const Image3D<T> diff(const Image3D<T> &image1, const Image3D<T> &image2){
 
-    Image3D<T> result(image1.dimX(), image1.dimY(), image1.dimZ());
+    Image3D<T> result(image1.dimX(), image1.dimY(), image1.dimZ(), uninitialized);
 
     if (image1.size() != image2.size()){
 		std::cout<<"Error Diff : Size of images are not the same."<<std::endl;
 	}
 	else {
-        auto it1 = image1.get_data().begin();
-        auto it2 = image2.get_data().begin();
-        auto it3 = result.get_data().begin();
-        for( ; it1 != image1.get_data().end() ; ++it1, ++it2, ++it3 )
-            *it3 = *it1 - *it2;
+        const T* a = image1.get_pointer();
+        const T* b = image2.get_pointer();
+        T* r = result.get_pointer();
+        parallel_simd_for(result.size(), [a, b, r](std::ptrdiff_t i) { r[i] = a[i] - b[i]; });
     }
 	return result;
 }
 
 
 
-// Min between image1 and image2. Result is stored in image1.
+// Min between image1 and image2 (an Image3D or a view). Result is stored in image1.
 template<typename T>
-int min_crush(Image3D<T> &image1, const Image3D<T> &image2)
+int min_crush(Image3D<T> &image1, const Image3DConstView<T> &image2)
 {
     if (image1.size() != image2.size()){
         std::cout<<"Error in Algo.hpp (min_crush l 55): "
                    <<"Size of images is not the same."<<std::endl;
 	}
+	else if (image2.is_contiguous()) {
+        T* a = image1.get_pointer();
+        const T* b = image2.get_pointer();
+        parallel_simd_for(image1.size(), [a, b](std::ptrdiff_t i) { a[i] = std::min( a[i], b[i] ); });
+	}
 	else {
         auto it1 = image1.get_data().begin();
-        auto it2 = image2.get_data().begin();
-        for( ; it1 != image1.get_data().end() ; ++it1, ++it2 )
-            *it1 = std::min( *it1, *it2 );
+        image2.for_each([&it1](const T& val) {
+            *it1 = std::min( *it1, val );
+            ++it1;
+        });
 	}
     return 0;
 }
 
 
-// Max between image1 and image2. Result is stored in image1.
+// Max between image1 and image2 (an Image3D or a view). Result is stored in image1.
 template<typename T>
-int max_crush(Image3D<T> &image1, const Image3D<T> &image2)
+int max_crush(Image3D<T> &image1, const Image3DConstView<T> &image2)
 {
     if (image1.size() != image2.size()){
         std::cout<<"Error in Algo.hpp (max_crush l 76): "
                    <<"Size of images is not the same."<<std::endl;
 	}
+	else if (image2.is_contiguous()) {
+        T* a = image1.get_pointer();
+        const T* b = image2.get_pointer();
+        parallel_simd_for(image1.size(), [a, b](std::ptrdiff_t i) { a[i] = std::max( a[i], b[i] ); });
+	}
 	else {
         auto it1 = image1.get_data().begin();
-        auto it2 = image2.get_data().begin();
-        for( ; it1 != image1.get_data().end() ; ++it1, ++it2 )
-            *it1 = std::max( *it1, *it2 );
+        image2.for_each([&it1](const T& val) {
+            *it1 = std::max( *it1, val );
+            ++it1;
+        });
 	}
     return 0;
 }
 
-// Apply the mask image mask to image image
+// Apply the mask image mask (an Image3D or a view) to image image
 template<typename T1, typename T2>
-void mask_image(Image3D<T1> &image, const Image3D<T2> &mask){
+void mask_image(Image3D<T1> &image, const Image3DConstView<T2> &mask){
     if (image.size() != mask.size()){
     std::cout<<"Error in Algo.hpp (mask_image l 96): "
                <<"Size of image and mask is not the same."<<std::endl;
 	}
+	else if (mask.is_contiguous()) {
+        T1* a = image.get_pointer();
+        const T2* m = mask.get_pointer();
+        parallel_simd_for(image.size(), [a, m](std::ptrdiff_t i) { a[i] = m[i] == 0 ? T1(0) : a[i]; });
+	}
 	else {
-        auto it1 = mask.get_data().begin();
         auto it2 = image.get_data().begin();
-        for( ; it1 != mask.get_data().end() ; ++it1, ++it2 )
-            if ( *it1 == 0 )
+        mask.for_each([&it2](const T2& val) {
+            if ( val == 0 )
                 *it2 = 0;
+            ++it2;
+        });
 	}
 }
 
@@ -132,4 +150,29 @@ float computeSTD(Iterator begin, Iterator end)
     return std;
 }
 
+// Same as computeSTD on the N values of an array, without call to pow (the
+// squares are computed in the type pow would return, so the result is the
+// same). N is a constant so that the loops are unrolled.
+template<int N, typename T>
+inline float computeSTD_array(const T* values)
+{
+    const int n = N;
+    float mean = 0;
+    #pragma GCC unroll 7
+    for (int i = 0; i < n; i++)
+        mean += values[i];
+    mean /= n + 1;
+
+    float std = 0;
+    #pragma GCC unroll 7
+    for (int i = 0; i < n; i++) {
+        auto d = values[i] - mean;
+        std += (decltype(d * 1.0)) d * d;
+    }
+    std /= n + 1;
+    std = sqrt(std);
+
+    return std;
+}
+
 #endif // ALGO_INCLUDED
@@ -0,0 +1,194 @@
+/* Copyright (C) 2014 Odyssee Merveille
+odyssee.merveille@gmail.com
+
+    This software is a computer program whose purpose is to compute RORPO.
+    This software is governed by the CeCILL-B license under French law and
+    abiding by the rules of distribution of free software.  You can  use,
+    modify and/ or redistribute the software under the terms of the CeCILL-B
+    license as circulated by CEA, CNRS and INRIA at the following URL
+    "http://www.cecill.info".
+
+    As a counterpart to the access to the source code and  rights to copy,
+    modify and redistribute granted by the license, users are provided only
+    with a limited warranty  and the software's author,  the holder of the
+    economic rights,  and the successive licensors  have only  limited
+    liability.
+
+    In this respect, the user's attention is drawn to the risks associated
+    with loading,  using,  modifying and/or developing or reproducing the
+    software by the user in light of its specific status of free software,
+    that may mean  that it is complicated to manipulate,  and  that  also
+    therefore means  that it is reserved for developers  and  experienced
+    professionals having in-depth computer knowledge. Users are therefore
+    encouraged to load and test the software's suitability as regards their
+    requirements in conditions enabling the security of their systems and/or
+    data to be ensured and,  more generally, to use and operate it in the
+    same conditions as regards security.
+
+    The fact that you are presently reading this means that you have had
+    knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#ifndef BITSET3D_INCLUDED
+#define BITSET3D_INCLUDED
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Image/Image.hpp"
+#include "RORPO/IndexType.hpp"
+
+// Binary 3D image packed in 64-bit words, each row starting on a new word
+// (bit x of a row is bit x%64 of word x/64). Used for the binary morphology
+// of the mask: a dilation is a few word-wise OR per row.
+class Bitset3D {
+
+public :
+
+	typedef uint64_t Word;
+	static const int WORD_BITS = 64;
+
+	Bitset3D(IndexType dimX, IndexType dimY, IndexType dimZ):
+		m_nDimX(dimX), m_nDimY(dimY), m_nDimZ(dimZ),
+		m_nWords((dimX + WORD_BITS - 1) / WORD_BITS),
+		m_vBits(m_nWords * dimY * dimZ, 0) {}
+
+	// Bits of the non-zero voxels of "mask", inside a border of "border" unset voxels
+	template<typename MaskType>
+	static Bitset3D from_mask(const Image3DView<const MaskType> &mask, int border) {
+		Bitset3D bits(mask.dimX() + 2 * border, mask.dimY() + 2 * border, mask.dimZ() + 2 * border);
+		for (IndexType z = 0; z < mask.dimZ(); ++z)
+			for (IndexType y = 0; y < mask.dimY(); ++y) {
+				Word* row = bits.row(y + border, z + border);
+				for (IndexType x = 0; x < mask.dimX(); ++x)
+					if (mask(x, y, z) != 0)
+						row[(x + border) / WORD_BITS] |= (Word) 1 << ((x + border) % WORD_BITS);
+			}
+		return bits;
+	}
+
+	IndexType dimX() const {
+		return m_nDimX;
+	}
+
+	IndexType dimY() const {
+		return m_nDimY;
+	}
+
+	IndexType dimZ() const {
+		return m_nDimZ;
+	}
+
+	bool test(IndexType x, IndexType y, IndexType z) const {
+		return (row(y, z)[x / WORD_BITS] >> (x % WORD_BITS)) & 1;
+	}
+
+	// Dilation by a (2*radius+1)^3 box clipped at the border of the volume
+	// (the binary rect3dminmax). Each axis is dilated by steps of radius
+	// 1, 3, 7, ... so that a radius r costs log2(r) passes.
+	void dilate(int radius) {
+		if (radius <= 0)
+			return;
+		dilate_rows(radius);
+		// y: lines of dimY rows, one per slice
+		dilate_lines(radius, m_nDimY, 1, m_nDimZ, m_nDimY);
+		// z: lines of dimZ rows, one per row of a slice
+		dilate_lines(radius, m_nDimZ, m_nDimY, m_nDimY, 1);
+	}
+
+	// b[x + y*dimX + z*dimX*dimY] = 0 for every unset voxel
+	void clear_unset(std::vector<bool> &b) const {
+		for (IndexType z = 0; z < m_nDimZ; ++z)
+			for (IndexType y = 0; y < m_nDimY; ++y) {
+				const Word* bits = row(y, z);
+				const IndexType offset = (y + z * m_nDimY) * m_nDimX;
+				for (IndexType w = 0; w < m_nWords; ++w) {
+					if (bits[w] == ~(Word) 0)
+						continue;
+					const IndexType end = std::min(m_nDimX, (w + 1) * WORD_BITS);
+					for (IndexType x = w * WORD_BITS; x < end; ++x)
+						if (!((bits[w] >> (x % WORD_BITS)) & 1))
+							b[offset + x] = 0;
+				}
+			}
+	}
+
+	private :
+
+		Word* row(IndexType y, IndexType z) {
+			return &m_vBits[(y + z * m_nDimY) * m_nWords];
+		}
+
+		const Word* row(IndexType y, IndexType z) const {
+			return &m_vBits[(y + z * m_nDimY) * m_nWords];
+		}
+
+		// out |= in shifted by s bits towards higher (s > 0) or lower (s < 0) x
+		void shift_or(const Word* in, Word* out, IndexType s) const {
+			const IndexType words = (s < 0 ? -s : s) / WORD_BITS;
+			const int bits = (s < 0 ? -s : s) % WORD_BITS;
+			for (IndexType w = 0; w < m_nWords; ++w) {
+				const IndexType src = s > 0 ? w - words : w + words;
+				const IndexType next = s > 0 ? src - 1 : src + 1;
+				Word v = 0;
+				if (src >= 0 && src < m_nWords)
+					v = s > 0 ? in[src] << bits : in[src] >> bits;
+				if (bits && next >= 0 && next < m_nWords)
+					v |= s > 0 ? in[next] >> (WORD_BITS - bits) : in[next] << (WORD_BITS - bits);
+				out[w] |= v;
+			}
+		}
+
+		// Dilation of every row along x
+		void dilate_rows(int radius) {
+			const int tail = m_nDimX % WORD_BITS;
+			const Word last = tail ? ((Word) 1 << tail) - 1 : ~(Word) 0;
+			std::vector<Word> tmp(m_nWords);
+			for (IndexType r = 0; r < m_nDimY * m_nDimZ; ++r) {
+				Word* bits = &m_vBits[r * m_nWords];
+				for (int done = 0; done < radius; ) {
+					const int s = std::min(done + 1, radius - done);
+					std::copy(bits, bits + m_nWords, tmp.begin());
+					shift_or(tmp.data(), bits, s);
+					shift_or(tmp.data(), bits, -s);
+					// clip at the end of the row
+					bits[m_nWords - 1] &= last;
+					done += s;
+				}
+			}
+		}
+
+		// Dilation along lines of n rows: row k of line l is row
+		// l * lineStride + k * stride of the volume
+		void dilate_lines(int radius, IndexType n, IndexType stride, IndexType lines, IndexType lineStride) {
+			std::vector<Word> tmp(n * m_nWords);
+			for (IndexType l = 0; l < lines; ++l) {
+				Word* first = &m_vBits[l * lineStride * m_nWords];
+				for (int done = 0; done < radius; ) {
+					const int s = std::min(done + 1, radius - done);
+					for (IndexType k = 0; k < n; ++k)
+						std::copy(first + k * stride * m_nWords, first + (k * stride + 1) * m_nWords, &tmp[k * m_nWords]);
+					for (IndexType k = 0; k < n; ++k) {
+						Word* out = first + k * stride * m_nWords;
+						if (k >= s)
+							for (IndexType w = 0; w < m_nWords; ++w)
+								out[w] |= tmp[(k - s) * m_nWords + w];
+						if (k + s < n)
+							for (IndexType w = 0; w < m_nWords; ++w)
+								out[w] |= tmp[(k + s) * m_nWords + w];
+					}
+					done += s;
+				}
+			}
+		}
+
+		IndexType m_nDimX;
+		IndexType m_nDimY;
+		IndexType m_nDimZ;
+		IndexType m_nWords;
+
+		std::vector<Word> m_vBits;
+};
+
+#endif // BITSET3D_INCLUDED
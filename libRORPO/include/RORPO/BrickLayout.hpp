@@ -0,0 +1,142 @@
+/* Copyright (C) 2014 Odyssee Merveille
+odyssee.merveille@gmail.com
+
+    This software is a computer program whose purpose is to compute RORPO.
+    This software is governed by the CeCILL-B license under French law and
+    abiding by the rules of distribution of free software.  You can  use,
+    modify and/ or redistribute the software under the terms of the CeCILL-B
+    license as circulated by CEA, CNRS and INRIA at the following URL
+    "http://www.cecill.info".
+
+    As a counterpart to the access to the source code and  rights to copy,
+    modify and redistribute granted by the license, users are provided only
+    with a limited warranty  and the software's author,  the holder of the
+    economic rights,  and the successive licensors  have only  limited
+    liability.
+
+    In this respect, the user's attention is drawn to the risks associated
+    with loading,  using,  modifying and/or developing or reproducing the
+    software by the user in light of its specific status of free software,
+    that may mean  that it is complicated to manipulate,  and  that  also
+    therefore means  that it is reserved for developers  and  experienced
+    professionals having in-depth computer knowledge. Users are therefore
+    encouraged to load and test the software's suitability as regards their
+    requirements in conditions enabling the security of their systems and/or
+    data to be ensured and,  more generally, to use and operate it in the
+    same conditions as regards security.
+
+    The fact that you are presently reading this means that you have had
+    knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#ifndef BRICKLAYOUT_INCLUDED
+#define BRICKLAYOUT_INCLUDED
+
+#include <vector>
+
+#include "RORPO/IndexType.hpp"
+
+// Bricked memory layout of a dimX x dimY x dimZ volume: the volume is cut
+// into 8x8x8 bricks stored one after the other (x fastest, then y, then z)
+// and the 512 voxels of a brick are stored contiguously (x fastest).
+// A voxel and its 26 neighbours then lie in at most 8 bricks of 2 KB (for
+// 32-bit states), whatever the orientation, instead of 9 rows spread over
+// 3 frames in the linear layout. Partial bricks are padded.
+class BrickLayout {
+
+public :
+
+	static const int BRICK_SIZE = 8;
+	static const int BRICK_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+	BrickLayout(IndexType dimX, IndexType dimY, IndexType dimZ):
+		m_nDimX(dimX), m_nDimY(dimY), m_nDimZ(dimZ),
+		m_nBricksX((dimX + BRICK_SIZE - 1) / BRICK_SIZE),
+		m_nBricksY((dimY + BRICK_SIZE - 1) / BRICK_SIZE),
+		m_nBricksZ((dimZ + BRICK_SIZE - 1) / BRICK_SIZE) {}
+
+	// Number of voxels of the layout, padding included
+	IndexType size() const {
+		return m_nBricksX * m_nBricksY * m_nBricksZ * BRICK_VOXELS;
+	}
+
+	// Index of voxel (x, y, z)
+	IndexType index(IndexType x, IndexType y, IndexType z) const {
+		IndexType brick = ((z / BRICK_SIZE) * m_nBricksY + y / BRICK_SIZE) * m_nBricksX + x / BRICK_SIZE;
+		return brick * BRICK_VOXELS
+			+ ((z % BRICK_SIZE) * BRICK_SIZE + y % BRICK_SIZE) * BRICK_SIZE + x % BRICK_SIZE;
+	}
+
+	// Index of the voxel at index i of the linear layout
+	IndexType from_linear(IndexType i) const {
+		return index(i % m_nDimX, (i / m_nDimX) % m_nDimY, i / (m_nDimX * m_nDimY));
+	}
+
+	// Index of the neighbour (p.x + dx, p.y + dy, p.z + dz) of voxel p,
+	// with dx, dy, dz in [-1, 1]. The neighbour must be in the volume.
+	// Only the position inside the brick is decoded, no division.
+	IndexType neighbour(IndexType p, int dx, int dy, int dz) const {
+		const int lx = p & (BRICK_SIZE - 1);
+		const int ly = (p / BRICK_SIZE) & (BRICK_SIZE - 1);
+		const int lz = (p / (BRICK_SIZE * BRICK_SIZE)) & (BRICK_SIZE - 1);
+		const int nx = lx + dx;
+		const int ny = ly + dy;
+		const int nz = lz + dz;
+
+		// -1, 0 or 1 brick along each axis
+		const IndexType brickShift = (IndexType) brick_shift(nz) * m_nBricksX * m_nBricksY
+									 + (IndexType) brick_shift(ny) * m_nBricksX + brick_shift(nx);
+		return p + brickShift * BRICK_VOXELS
+			+ ((nz & (BRICK_SIZE - 1)) - lz) * BRICK_SIZE * BRICK_SIZE
+			+ ((ny & (BRICK_SIZE - 1)) - ly) * BRICK_SIZE
+			+ ((nx & (BRICK_SIZE - 1)) - lx);
+	}
+
+	// Copy of a linear array in the bricked layout, the padding is set to "padding"
+	template<typename T>
+	std::vector<T> to_bricks(const std::vector<T> &linear, const T &padding) const {
+		std::vector<T> bricks(size(), padding);
+		IndexType i = 0;
+		for (IndexType z = 0; z < m_nDimZ; ++z)
+			for (IndexType y = 0; y < m_nDimY; ++y)
+				for (IndexType x = 0; x < m_nDimX; ++x)
+					bricks[index(x, y, z)] = linear[i++];
+		return bricks;
+	}
+
+	// Indices of the linear layout converted to the bricked layout
+	std::vector<IndexType> from_linear(const std::vector<IndexType> &indices) const {
+		std::vector<IndexType> bricks(indices.size());
+		for (std::size_t i = 0; i < indices.size(); ++i)
+			bricks[i] = from_linear(indices[i]);
+		return bricks;
+	}
+
+	// Index in the linear layout of every voxel of the bricked layout
+	// (-1 for the padding)
+	std::vector<IndexType> linear_indices() const {
+		std::vector<IndexType> linear(size(), -1);
+		IndexType i = 0;
+		for (IndexType z = 0; z < m_nDimZ; ++z)
+			for (IndexType y = 0; y < m_nDimY; ++y)
+				for (IndexType x = 0; x < m_nDimX; ++x)
+					linear[index(x, y, z)] = i++;
+		return linear;
+	}
+
+	private :
+		// Brick shift of a position in [-1, BRICK_SIZE]
+		static int brick_shift(int n) {
+			return n < 0 ? -1 : (n >= BRICK_SIZE ? 1 : 0);
+		}
+
+		IndexType m_nDimX;
+		IndexType m_nDimY;
+		IndexType m_nDimZ;
+
+		IndexType m_nBricksX;
+		IndexType m_nBricksY;
+		IndexType m_nBricksZ;
+};
+
+#endif // BRICKLAYOUT_INCLUDED
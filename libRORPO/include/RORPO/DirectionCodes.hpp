@@ -0,0 +1,134 @@
+/* Copyright (C) 2014 Odyssee Merveille
+odyssee.merveille@gmail.com
+
+    This software is a computer program whose purpose is to compute RORPO.
+    This software is governed by the CeCILL-B license under French law and
+    abiding by the rules of distribution of free software.  You can  use,
+    modify and/ or redistribute the software under the terms of the CeCILL-B
+    license as circulated by CEA, CNRS and INRIA at the following URL
+    "http://www.cecill.info".
+
+    As a counterpart to the access to the source code and  rights to copy,
+    modify and redistribute granted by the license, users are provided only
+    with a limited warranty  and the software's author,  the holder of the
+    economic rights,  and the successive licensors  have only  limited
+    liability.
+
+    In this respect, the user's attention is drawn to the risks associated
+    with loading,  using,  modifying and/or developing or reproducing the
+    software by the user in light of its specific status of free software,
+    that may mean  that it is complicated to manipulate,  and  that  also
+    therefore means  that it is reserved for developers  and  experienced
+    professionals having in-depth computer knowledge. Users are therefore
+    encouraged to load and test the software's suitability as regards their
+    requirements in conditions enabling the security of their systems and/or
+    data to be ensured and,  more generally, to use and operate it in the
+    same conditions as regards security.
+
+    The fact that you are presently reading this means that you have had
+    knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#ifndef DIRECTION_CODES_INCLUDED
+#define DIRECTION_CODES_INCLUDED
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Orientations of the RPO (same order as in RPO())
+static const int RORPO_ORIENTATIONS[7][3] = {
+    {1, 0, 0},//1
+    {0, 1, 0},//2
+    {0, 0, 1},//3
+    {1, 1, 1},//4
+    {1, 1, -1},//5
+    {-1, 1, 1},//6
+    {-1, 1, -1},//7
+};
+
+
+// The direction of a voxel is the sum of its 1 to 3 orientations of interest,
+// so there are only a few distinct directions: each one gets a 1-byte code.
+// Code 0 is the null direction (voxels which are not estimated).
+class Direction_Codes {
+
+public :
+
+	static const Direction_Codes& instance() {
+		static const Direction_Codes codes;
+		return codes;
+	}
+
+	// Code of the sum of the orientations whose bit is set in "orientations"
+	// (bit o for the orientation o, from 0 to 6)
+	uint8_t code( unsigned int orientations ) const {
+		return m_vCodeOfSet[orientations & 127];
+	}
+
+	// Direction of a code, as written by RORPO in the int directions
+	const std::array<int, 3>& vector( uint8_t code ) const {
+		return m_vVectors[code];
+	}
+
+	// Normalized direction of a code, (0, 0, 0) for the null direction
+	std::array<float, 3> unit_vector( uint8_t code ) const {
+		const std::array<int, 3>& v = m_vVectors[code];
+		const float norm = std::sqrt((float) (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]));
+		if (norm == 0)
+			return {0, 0, 0};
+		return {v[0] / norm, v[1] / norm, v[2] / norm};
+	}
+
+	// Number of codes, null direction included
+	std::size_t size() const {
+		return m_vVectors.size();
+	}
+
+	private :
+
+		// Directions of all the sets of 1 to 3 orientations, identical sums
+		// sharing the same code
+		Direction_Codes(): m_vVectors(1, std::array<int, 3>{0, 0, 0}), m_vCodeOfSet(128, 0) {
+			for (unsigned int set = 1; set < 128; ++set) {
+				int count = 0;
+				std::array<int, 3> v = {0, 0, 0};
+				for (int o = 0; o < 7; ++o)
+					if (set & (1u << o)) {
+						++count;
+						for (int c = 0; c < 3; ++c)
+							v[c] += RORPO_ORIENTATIONS[o][c];
+					}
+				if (count > 3)
+					continue;
+
+				std::size_t code = 1;
+				while (code < m_vVectors.size() && m_vVectors[code] != v)
+					++code;
+				if (code == m_vVectors.size())
+					m_vVectors.push_back(v);
+				m_vCodeOfSet[set] = (uint8_t) code;
+			}
+		}
+
+		std::vector<std::array<int, 3>> m_vVectors;
+		std::vector<uint8_t> m_vCodeOfSet;
+};
+
+
+// Expand direction codes to 3 ints per voxel (the int directions of RORPO)
+inline std::vector<int> expand_direction_codes(const std::vector<uint8_t> &codes) {
+	const Direction_Codes& table = Direction_Codes::instance();
+	std::vector<int> directions(codes.size() * 3);
+	#pragma omp parallel for
+	for (std::ptrdiff_t i = 0; i < (std::ptrdiff_t) codes.size(); i++) {
+		const std::array<int, 3>& v = table.vector(codes[i]);
+		directions[i * 3] = v[0];
+		directions[i * 3 + 1] = v[1];
+		directions[i * 3 + 2] = v[2];
+	}
+	return directions;
+}
+
+#endif // DIRECTION_CODES_INCLUDED
@@ -35,57 +35,182 @@ odyssee.merveille@gmail.com
 #include <stdlib.h>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <array>
+#include <queue>
+#include <algorithm>
 
-#include "RORPO/pink/mcimage.h"
-#include "RORPO/pink/mccodimage.h"
-#include "RORPO/pink/lgeodesic.h"
+#include "Image/Image.hpp"
+#include "RORPO/IndexType.hpp"
 
 
+// Offsets (dx, dy, dz) of the 6, 18 or 26 neighbours of a voxel.
+// Return an empty list if connex is not one of these values.
+inline std::vector<std::array<int, 3>> geodilation_neighbourhood(int connex)
+{
+    std::vector<std::array<int, 3>> neighbours;
+
+    if (connex != 6 && connex != 18 && connex != 26)
+        return neighbours;
+
+    for (int dz = -1; dz <= 1; ++dz)
+        for (int dy = -1; dy <= 1; ++dy)
+            for (int dx = -1; dx <= 1; ++dx) {
+                int nb_shift = std::abs(dx) + std::abs(dy) + std::abs(dz);
+                if (nb_shift == 0)
+                    continue;
+                if ((connex == 6 && nb_shift > 1) || (connex == 18 && nb_shift > 2))
+                    continue;
+                neighbours.push_back({dx, dy, dz});
+            }
+    return neighbours;
+}
+
 
+// Geodesic dilation of the marker G under the mask R with the given
+// connexity (6, 18 or 26). niter is the number of elementary dilations,
+// -1 means until stability (i.e. the reconstruction by dilation).
+// Works for every pixel type, including 8-byte integers and floating types.
 template<typename T>
-Image3D<T> geodilation(Image3D<T> &G, Image3D<T> &R, int connex, int niter)
+Image3D<T> geodilation(const Image3D<T> &G, const Image3D<T> &R, int connex, int niter)
 {
-    Image3D<T> geodilat(G.dimX(), G.dimY(), G.dimZ());
-
-	// Pink Images
-    struct xvimage* imageG;
-    struct xvimage* imageR;
-    struct xvimage* temp;
-    int32_t typepixel;
-
-	if (sizeof(T)==1)
-   		typepixel = VFF_TYP_1_BYTE;
-   	else if (sizeof(T)==2)
-		typepixel = VFF_TYP_2_BYTE;
-	else if (sizeof(T)==4)
-		typepixel = VFF_TYP_4_BYTE;
-	else
-		std::cerr<<"Error in Geodilation : ImageType not known"<<std::endl;
-
-    imageG=allocheader(NULL,G.dimX(),G.dimY(),G.dimZ(),typepixel);
-    imageG->image_data= G.get_pointer();
-
-    imageR=allocheader(NULL,G.dimX(),G.dimY(),G.dimZ(),typepixel);
-    imageR->image_data= R.get_pointer();
-
-    temp=copyimage(imageG);
-
-    lgeodilat(temp,imageR,connex,niter);
-
-    for (int z = 0; z<G.dimZ()  ; ++z){
-		for (int y = 0; y<G.dimY() ; ++y){
-			for (int x = 0; x<G.dimX(); ++x){
-                    geodilat(x, y, z) = ((T *)(temp->image_data))[x
-                            + y * G.dimX() + z * G.dimX() * G.dimY()];
-			}
-		}
-	}
-
-    free(imageR);
-    free(imageG);
-    free(temp);
-
-   return geodilat;
+    const int dimX = G.dimX();
+    const int dimY = G.dimY();
+    const int dimZ = G.dimZ();
+    const IndexType dimFrame = (IndexType) dimX * dimY;
+
+    Image3D<T> geodilat(dimX, dimY, dimZ);
+
+    if (G.size() != R.size()) {
+        std::cerr<<"Error in Geodilation : Size of images are not the same."<<std::endl;
+        return geodilat;
+    }
+
+    std::vector<std::array<int, 3>> neighbours = geodilation_neighbourhood(connex);
+    if (neighbours.empty()) {
+        std::cerr<<"Error in Geodilation : bad connexity "<<connex<<std::endl;
+        return geodilat;
+    }
+
+    // Linear offsets of the neighbours, and the ones preceding a voxel in
+    // the raster order (forward scan) or following it (backward scan)
+    std::vector<IndexType> offsets, forward, backward;
+    std::vector<std::array<int, 3>> forwardShift, backwardShift;
+    for (const auto &n : neighbours) {
+        IndexType offset = n[0] + (IndexType) n[1] * dimX + n[2] * dimFrame;
+        offsets.push_back(offset);
+        if (offset < 0) {
+            forward.push_back(offset);
+            forwardShift.push_back(n);
+        } else {
+            backward.push_back(offset);
+            backwardShift.push_back(n);
+        }
+    }
+
+    const T *mask = R.get_pointer();
+    T *J = geodilat.get_pointer();
+
+    // Force the marker to be under the mask
+    for (size_t i = 0; i < G.size(); ++i)
+        J[i] = std::min(G(i), mask[i]);
+
+    // true if the neighbour (x, y, z) + shift lies in the image
+    auto inside = [&](int x, int y, int z, const std::array<int, 3> &shift) {
+        return x + shift[0] >= 0 && x + shift[0] < dimX &&
+               y + shift[1] >= 0 && y + shift[1] < dimY &&
+               z + shift[2] >= 0 && z + shift[2] < dimZ;
+    };
+    auto onBorder = [&](int x, int y, int z) {
+        return x == 0 || y == 0 || z == 0 ||
+               x == dimX - 1 || y == dimY - 1 || z == dimZ - 1;
+    };
+
+    // ---------------- Fixed number of elementary dilations ----------------
+    if (niter != -1) {
+        std::vector<T> H(J, J + G.size());
+        for (int iter = 0; iter < niter; ++iter) {
+            bool changed = false;
+            for (int z = 0; z < dimZ; ++z)
+                for (int y = 0; y < dimY; ++y)
+                    for (int x = 0; x < dimX; ++x) {
+                        IndexType p = x + (IndexType) y * dimX + z * dimFrame;
+                        T sup = J[p];
+                        bool border = onBorder(x, y, z);
+                        for (size_t k = 0; k < offsets.size(); ++k)
+                            if (!border || inside(x, y, z, neighbours[k]))
+                                sup = std::max(sup, J[p + offsets[k]]);
+                        sup = std::min(sup, mask[p]);
+                        if (sup != J[p])
+                            changed = true;
+                        H[p] = sup;
+                    }
+            std::copy(H.begin(), H.end(), J);
+            if (!changed)
+                break;
+        }
+        return geodilat;
+    }
+
+    // ------------ Reconstruction: hybrid algorithm (L. Vincent) -----------
+
+    // Forward raster scan
+    for (int z = 0; z < dimZ; ++z)
+        for (int y = 0; y < dimY; ++y)
+            for (int x = 0; x < dimX; ++x) {
+                IndexType p = x + (IndexType) y * dimX + z * dimFrame;
+                T sup = J[p];
+                bool border = onBorder(x, y, z);
+                for (size_t k = 0; k < forward.size(); ++k)
+                    if (!border || inside(x, y, z, forwardShift[k]))
+                        sup = std::max(sup, J[p + forward[k]]);
+                J[p] = std::min(sup, mask[p]);
+            }
+
+    // Backward raster scan, collecting the voxels which can still propagate
+    std::queue<IndexType> fifo;
+    for (int z = dimZ - 1; z >= 0; --z)
+        for (int y = dimY - 1; y >= 0; --y)
+            for (int x = dimX - 1; x >= 0; --x) {
+                IndexType p = x + (IndexType) y * dimX + z * dimFrame;
+                T sup = J[p];
+                bool border = onBorder(x, y, z);
+                for (size_t k = 0; k < backward.size(); ++k)
+                    if (!border || inside(x, y, z, backwardShift[k]))
+                        sup = std::max(sup, J[p + backward[k]]);
+                J[p] = std::min(sup, mask[p]);
+
+                for (size_t k = 0; k < backward.size(); ++k) {
+                    if (border && !inside(x, y, z, backwardShift[k]))
+                        continue;
+                    IndexType q = p + backward[k];
+                    if (J[q] < J[p] && J[q] < mask[q]) {
+                        fifo.push(p);
+                        break;
+                    }
+                }
+            }
+
+    // Propagation
+    while (!fifo.empty()) {
+        IndexType p = fifo.front();
+        fifo.pop();
+        int z = p / dimFrame;
+        int y = (p - z * dimFrame) / dimX;
+        int x = p - z * dimFrame - (IndexType) y * dimX;
+        bool border = onBorder(x, y, z);
+        for (size_t k = 0; k < offsets.size(); ++k) {
+            if (border && !inside(x, y, z, neighbours[k]))
+                continue;
+            IndexType q = p + offsets[k];
+            if (J[q] < J[p] && J[q] != mask[q]) {
+                J[q] = std::min(J[p], mask[q]);
+                fifo.push(q);
+            }
+        }
+    }
+
+    return geodilat;
 }
 
 #endif // GEODILATION_INCLUDED
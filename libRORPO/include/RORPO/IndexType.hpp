@@ -0,0 +1,56 @@
+/* Copyright (C) 2014 Odyssee Merveille
+odyssee.merveille@gmail.com
+
+    This software is a computer program whose purpose is to compute RORPO.
+    This software is governed by the CeCILL-B license under French law and
+    abiding by the rules of distribution of free software.  You can  use,
+    modify and/ or redistribute the software under the terms of the CeCILL-B
+    license as circulated by CEA, CNRS and INRIA at the following URL
+    "http://www.cecill.info".
+
+    As a counterpart to the access to the source code and  rights to copy,
+    modify and redistribute granted by the license, users are provided only
+    with a limited warranty  and the software's author,  the holder of the
+    economic rights,  and the successive licensors  have only  limited
+    liability.
+
+    In this respect, the user's attention is drawn to the risks associated
+    with loading,  using,  modifying and/or developing or reproducing the
+    software by the user in light of its specific status of free software,
+    that may mean  that it is complicated to manipulate,  and  that  also
+    therefore means  that it is reserved for developers  and  experienced
+    professionals having in-depth computer knowledge. Users are therefore
+    encouraged to load and test the software's suitability as regards their
+    requirements in conditions enabling the security of their systems and/or
+    data to be ensured and,  more generally, to use and operate it in the
+    same conditions as regards security.
+
+    The fact that you are presently reading this means that you have had
+    knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#ifndef INDEXTYPE_INCLUDED
+#define INDEXTYPE_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+
+// Type of the voxel indices and neighbour offsets used by the path opening
+// and the geodesic reconstruction (sorted index, queues, offsets).
+// Indices are 64-bit by default so that volumes larger than 2^31 voxels are
+// handled. Define RORPO_32BIT_INDEX (CMake option of the same name) to use
+// 32-bit indices and halve the size of the index arrays on smaller volumes.
+#ifdef RORPO_32BIT_INDEX
+typedef int32_t IndexType;
+#else
+typedef int64_t IndexType;
+#endif
+
+// Return true if a volume of "size" voxels can be addressed with IndexType
+inline bool fits_index_type(std::size_t size)
+{
+    return size <= (std::size_t) std::numeric_limits<IndexType>::max();
+}
+
+#endif // INDEXTYPE_INCLUDED
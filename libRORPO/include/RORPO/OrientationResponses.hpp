@@ -0,0 +1,156 @@
+/* Copyright (C) 2014 Odyssee Merveille
+odyssee.merveille@gmail.com
+
+    This software is a computer program whose purpose is to compute RORPO.
+    This software is governed by the CeCILL-B license under French law and
+    abiding by the rules of distribution of free software.  You can  use,
+    modify and/ or redistribute the software under the terms of the CeCILL-B
+    license as circulated by CEA, CNRS and INRIA at the following URL
+    "http://www.cecill.info".
+
+    As a counterpart to the access to the source code and  rights to copy,
+    modify and redistribute granted by the license, users are provided only
+    with a limited warranty  and the software's author,  the holder of the
+    economic rights,  and the successive licensors  have only  limited
+    liability.
+
+    In this respect, the user's attention is drawn to the risks associated
+    with loading,  using,  modifying and/or developing or reproducing the
+    software by the user in light of its specific status of free software,
+    that may mean  that it is complicated to manipulate,  and  that  also
+    therefore means  that it is reserved for developers  and  experienced
+    professionals having in-depth computer knowledge. Users are therefore
+    encouraged to load and test the software's suitability as regards their
+    requirements in conditions enabling the security of their systems and/or
+    data to be ensured and,  more generally, to use and operate it in the
+    same conditions as regards security.
+
+    The fact that you are presently reading this means that you have had
+    knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#ifndef ORIENTATION_RESPONSES_INCLUDED
+#define ORIENTATION_RESPONSES_INCLUDED
+
+#include <cstddef>
+#include <vector>
+
+#include "Image/Image.hpp"
+
+// Storage of the responses of the 7 orientations.
+// Planar : one plane of size() voxels per orientation (like 7 Image3D).
+// Interleaved : the 7 responses of a voxel are contiguous, padded to 8
+// lanes, so that a per-voxel consumer streams a single array.
+enum class Responses_Layout { Planar, Interleaved };
+
+template<typename T, typename Allocator = Image_Allocator<T>>
+class OrientationResponses {
+
+public :
+
+	static const int NB_ORIENTATIONS = 7;
+	static const int LANES = 8;
+
+	OrientationResponses(): m_nDimX(0), m_nDimY(0), m_nDimZ(0), m_nSize(0),
+		m_layout(Responses_Layout::Planar) {}
+
+	// The responses are left uninitialized, as well as the padding lane of
+	// the interleaved layout
+	OrientationResponses(unsigned int dimX, unsigned int dimY, unsigned int dimZ,
+						 Responses_Layout layout = Responses_Layout::Planar):
+		m_nDimX(dimX), m_nDimY(dimY), m_nDimZ(dimZ), m_nSize((std::size_t) dimX * dimY * dimZ),
+		m_layout(layout),
+		m_vData(m_nSize * (layout == Responses_Layout::Interleaved ? LANES : NB_ORIENTATIONS)) {}
+
+	// Response of orientation o (0 to 6) at voxel i
+	T& operator ()( int o, std::size_t i ) {
+		return m_vData[o * orientation_stride() + i * voxel_stride()];
+	}
+	const T& operator ()( int o, std::size_t i ) const {
+		return m_vData[o * orientation_stride() + i * voxel_stride()];
+	}
+
+	// Distance (in elements) between the responses of two consecutive
+	// orientations of a voxel
+	std::ptrdiff_t orientation_stride() const {
+		return m_layout == Responses_Layout::Interleaved ? 1 : (std::ptrdiff_t) m_nSize;
+	}
+
+	// Distance (in elements) between the responses of two consecutive voxels
+	std::ptrdiff_t voxel_stride() const {
+		return m_layout == Responses_Layout::Interleaved ? LANES : 1;
+	}
+
+	// Strided view on the responses of orientation o
+	Image3DView<T> view( int o ) {
+		const std::ptrdiff_t s = voxel_stride();
+		return Image3DView<T>(get_pointer() + o * orientation_stride(), m_nDimX, m_nDimY, m_nDimZ,
+							  s, s * m_nDimX, s * (std::ptrdiff_t) m_nDimX * m_nDimY,
+							  1.0, 1.0, 1.0, 0.0, 0.0, 0.0);
+	}
+	Image3DView<const T> view( int o ) const {
+		const std::ptrdiff_t s = voxel_stride();
+		return Image3DView<const T>(get_pointer() + o * orientation_stride(), m_nDimX, m_nDimY, m_nDimZ,
+									s, s * m_nDimX, s * (std::ptrdiff_t) m_nDimX * m_nDimY,
+									1.0, 1.0, 1.0, 0.0, 0.0, 0.0);
+	}
+
+	// Copy of the responses of orientation o
+	Image3D<T> image( int o ) const {
+		return Image3D<T>::from_view(view(o));
+	}
+
+	Responses_Layout layout() const {
+		return m_layout;
+	}
+
+	unsigned int dimX() const {
+		return m_nDimX;
+	}
+
+	unsigned int dimY() const {
+		return m_nDimY;
+	}
+
+	unsigned int dimZ() const {
+		return m_nDimZ;
+	}
+
+	// Number of voxels
+	std::size_t size() const {
+		return m_nSize;
+	}
+
+	bool empty() const {
+		return m_vData.empty();
+	}
+
+	std::vector<T, Allocator>& get_data() {
+		return m_vData;
+	}
+	const std::vector<T, Allocator>& get_data() const {
+		return m_vData;
+	}
+
+	T* get_pointer() {
+		return m_vData.data();
+	}
+	const T* get_pointer() const {
+		return m_vData.data();
+	}
+
+	void clear() {
+		m_vData.clear();
+		m_vData.shrink_to_fit();
+	}
+
+	private :
+		unsigned int m_nDimX;
+		unsigned int m_nDimY;
+		unsigned int m_nDimZ;
+		std::size_t m_nSize;
+		Responses_Layout m_layout;
+		std::vector<T, Allocator> m_vData;
+};
+
+#endif // ORIENTATION_RESPONSES_INCLUDED
@@ -42,24 +42,38 @@ doi: 10.1109/TIP.2010.2044959
 #include <string>
 #include <omp.h>
 #include <vector>
+#include <array>
 #include <queue>
 #include <algorithm>
 #include <iterator>
 #include <cassert>
 
 #include "RORPO/pink/rect3dmm.hpp"
+#include "RORPO/IndexType.hpp"
+#include "RORPO/BrickLayout.hpp"
+#include "RORPO/SkewLayout.hpp"
 #include "RORPO/sorting.hpp"
 #include "Image/Image.hpp"
 #include "RORPO/Algo.hpp"
 
-typedef long IndexType;
 
+// Memory layout of the state arrays of the Path Opening (lambda, b, ...)
+enum class PO_Layout {
+    Linear, // layout of Image3D, constant neighbour offsets
+    Bricked, // BrickLayout, better locality for the diagonal orientations
+    Skewed // Linear, the diagonal orientations being run on a sheared copy (SkewLayout)
+};
 
-void create_neighbourhood(int nb_col,
-			int dim_frame,
+// Path lengths (Lp, Lm) of the Path Opening, allocated like the images (huge
+// pages, buffer pool)
+typedef std::vector<int, Image_Allocator<int>> PO_Lengths;
+
+
+void create_neighbourhood(IndexType nb_col,
+			IndexType dim_frame,
 			const std::vector<int> & orientation,
-			std::vector<int> & upList,
-			std::vector<int> & downList) {
+			std::vector<IndexType> & upList,
+			std::vector<IndexType> & downList) {
 
     int col_shift = orientation[0];
     int line_shift = orientation[1];
@@ -257,9 +271,72 @@ void create_neighbourhood(int nb_col,
 }
 
 
-template<typename PixelType>
-void propagate(IndexType p, std::vector<int>&lambda, std::vector<int>&nf,
-               std::vector<int>&nb, std::vector<bool>&b,
+// Shifts (dx, dy, dz) of the neighbourhoods of create_neighbourhood.
+// With nb_col = 3 and dim_frame = 9, an offset dz*9 + dy*3 + dx is written
+// in balanced ternary, so each offset gives back its shift.
+void create_neighbourhood_shifts(const std::vector<int> & orientation,
+            std::vector<std::array<int,3>> & upList,
+            std::vector<std::array<int,3>> & downList) {
+
+    std::vector<IndexType> up;
+    std::vector<IndexType> down;
+    create_neighbourhood(3, 9, orientation, up, down);
+
+    auto shift = [](IndexType offset) {
+        int o = offset + 13;
+        return std::array<int,3>{o % 3 - 1, (o / 3) % 3 - 1, o / 9 - 1};
+    };
+    for (IndexType offset : up)
+        upList.push_back(shift(offset));
+    for (IndexType offset : down)
+        downList.push_back(shift(offset));
+}
+
+
+// Neighbours of a voxel in the linear layout: constant offsets
+class LinearNeighbourhood {
+public:
+    LinearNeighbourhood(const std::vector<IndexType> &offsets): m_offsets(offsets) {}
+
+    template<typename Function>
+    void for_each(IndexType p, Function f) const {
+        for (IndexType offset : m_offsets)
+            f(p + offset);
+    }
+
+private:
+    std::vector<IndexType> m_offsets;
+};
+
+// Neighbours of a voxel in a BrickLayout. The offset to a neighbour only
+// depends on the position of the voxel inside its brick, so the offsets of
+// the 512 positions are computed once from the shifts.
+class BrickNeighbourhood {
+public:
+    BrickNeighbourhood(const BrickLayout &layout, const std::vector<std::array<int,3>> &shifts):
+        m_nNeighbours(shifts.size()), m_offsets(BrickLayout::BRICK_VOXELS * shifts.size()) {
+        for (IndexType l = 0; l < BrickLayout::BRICK_VOXELS; ++l)
+            for (std::size_t k = 0; k < m_nNeighbours; ++k)
+                m_offsets[l * m_nNeighbours + k] =
+                    layout.neighbour(l, shifts[k][0], shifts[k][1], shifts[k][2]) - l;
+    }
+
+    template<typename Function>
+    void for_each(IndexType p, Function f) const {
+        const IndexType* offsets = &m_offsets[(p & (BrickLayout::BRICK_VOXELS - 1)) * m_nNeighbours];
+        for (std::size_t k = 0; k < m_nNeighbours; ++k)
+            f(p + offsets[k]);
+    }
+
+private:
+    std::size_t m_nNeighbours;
+    std::vector<IndexType> m_offsets;
+};
+
+
+template<typename PixelType, typename Neighbourhood>
+void propagate(IndexType p, PO_Lengths &lambda, const Neighbourhood &nf,
+               const Neighbourhood &nb, std::vector<bool>&b,
                std::queue<IndexType> &Qc)
 
 // Propagation from pixel p
@@ -267,82 +344,76 @@ void propagate(IndexType p, std::vector<int>&lambda, std::vector<int>&nf,
 	std::queue<IndexType> Qq;
 	lambda[p]=0;
 
-	std::vector<int>::iterator it;
-	for (it=nf.begin(); it!=nf.end();++it)
-	{
-		if ((p+*it)<lambda.size() && b[p+*it])
+	nf.for_each(p, [&](IndexType n) {
+		if ((std::size_t) n<lambda.size() && b[n])
 		{
-			Qq.push(p+*it);
+			Qq.push(n);
 		}
-	}
+	});
 
 	while (! Qq.empty())
 	{
 		IndexType q=Qq.front();
 		Qq.pop();
 		int l=0;
-		for (it=nb.begin(); it!=nb.end();++it)
-		{
-			l=std::max(lambda[q+*it],l);
-		}
+		nb.for_each(q, [&](IndexType n) {
+			l=std::max(lambda[n],l);
+		});
 		l+=1;
 
 		if (l<lambda[q])
 		{
 			lambda[q]=l;
 			Qc.push(q);
-			for (it=nf.begin(); it!=nf.end(); ++it)
-			{
-				if (b[q+*it])
+			nf.for_each(q, [&](IndexType n) {
+				if (b[n])
 				{
-					Qq.push(q+*it);
+					Qq.push(n);
 				}
-			}
+			});
 		}
 	}
 }
 
-template<typename T, typename MaskType>
-void PO_3D(const Image3D<T> &image,
+// Path Opening on state arrays of "size" voxels in any layout. index_image
+// gives the voxels by increasing intensity, np/nm their neighbourhoods, and
+// output_index(q) the index in Output of the voxel q of the layout.
+template<typename T, typename Neighbourhood, typename OutputIndex>
+void PO_3D_layout(std::size_t size,
 		int L,
-		std::vector<IndexType> &index_image,
-		const std::vector<int> &orientations,
+		const std::vector<IndexType> &index_image,
+		const Neighbourhood &np,
+		const Neighbourhood &nm,
+		OutputIndex output_index,
 		Image3D<T> &Output,
-		std::vector<bool> b)
-
+		std::vector<bool> &b)
 {
-
-	// Create the offset np and nm
-	std::vector<int>np;
-	std::vector<int>nm;
-    create_neighbourhood(image.dimX(), image.dimX() * image.dimY(),
-                         orientations, np, nm);
-
 	//Create other temporary images
-    std::vector<int>Lp(image.size(), L);
-    std::vector<int>Lm(image.size(), L);
+    PO_Lengths Lp(size, L);
+    PO_Lengths Lm(size, L);
+    Huge_Pages::instance().account(Lp.data(), size * sizeof(int));
+    Huge_Pages::instance().account(Lm.data(), size * sizeof(int));
 
 	//Create FIFO queue Qc
 	std::queue<IndexType> Qc;
 
 	// Propagate
-	std::vector<IndexType>::iterator it;
-	int indice;
-    for (it = index_image.begin(), indice = 0 ; it != index_image.end() ;
-         ++it , ++indice)
+	std::vector<IndexType>::const_iterator it;
+    for (it = index_image.begin() ; it != index_image.end() ; ++it)
 	{
 		if (b[*it])
 		{
 			propagate<T>(*it, Lm, np, nm, b, Qc);
 			propagate<T>(*it, Lp, nm, np, b, Qc);
 
+			const T value = Output.get_data()[output_index(*it)];
 			while (! Qc.empty())
 			{
 				IndexType q = Qc.front();
 				Qc.pop();
 				if (Lp[q] + Lm[q]-1 < L)
 				{
-					Output.get_data()[q] = Output.get_data()[*it];
+					Output.get_data()[output_index(q)] = value;
 					b[q] = 0;
 					Lp[q] = 0;
 					Lm[q] = 0;
@@ -352,5 +423,174 @@ void PO_3D(const Image3D<T> &image,
 	}
 }
 
+template<typename T, typename MaskType>
+void PO_3D(const Image3D<T> &image,
+		int L,
+		const std::vector<IndexType> &index_image,
+		const std::vector<int> &orientations,
+		Image3D<T> &Output,
+		std::vector<bool> b)
+
+{
+
+	// Create the offset np and nm
+	std::vector<IndexType>np;
+	std::vector<IndexType>nm;
+    create_neighbourhood(image.dimX(), (IndexType) image.dimX() * image.dimY(),
+                         orientations, np, nm);
+
+    PO_3D_layout(image.size(), L, index_image,
+                 LinearNeighbourhood(np), LinearNeighbourhood(nm),
+                 [](IndexType q) { return q; }, Output, b);
+}
+
+// Slab j of "slabs" slabs of planes of a volume of dimZ planes (PO_3D_slab):
+// its planes [z_begin, z_end), and [s_begin, s_end) the slab extended by the
+// L+1 planes a path of length L through them can reach on each side
+struct PO_Slab {
+
+	PO_Slab(IndexType dimZ, int L, int slabs, int j):
+		z_begin((IndexType) ((std::size_t) dimZ * j / slabs)),
+		z_end((IndexType) ((std::size_t) dimZ * (j + 1) / slabs)),
+		s_begin(z_begin > L + 1 ? z_begin - (L + 1) : 0),
+		s_end(std::min(dimZ, z_end + L + 1)) {}
+
+	IndexType z_begin;
+	IndexType z_end;
+	IndexType s_begin;
+	IndexType s_end;
+};
+
+// Sorted indices of each of the "slabs" slabs (PO_Slab) of a volume of dimZ
+// planes of "frame" voxels, relative to the first voxel of the extended slab
+// and in the order of index_image, in a single pass for all the slabs
+inline std::vector<std::vector<IndexType>> PO_slab_indices(const std::vector<IndexType> &index_image,
+		IndexType frame,
+		IndexType dimZ,
+		int L,
+		int slabs)
+{
+	std::vector<PO_Slab> geometry;
+	std::vector<std::vector<IndexType>> slab_index(slabs);
+	for (int j = 0; j < slabs; ++j) {
+		geometry.emplace_back(dimZ, L, slabs, j);
+		slab_index[j].reserve((std::size_t) (geometry[j].s_end - geometry[j].s_begin) * frame);
+	}
+
+	// First and last slab extended over each plane
+	std::vector<int> first(dimZ, slabs);
+	std::vector<int> last(dimZ, -1);
+	for (int j = 0; j < slabs; ++j)
+		for (IndexType z = geometry[j].s_begin; z < geometry[j].s_end; ++z) {
+			first[z] = std::min(first[z], j);
+			last[z] = std::max(last[z], j);
+		}
+
+	for (IndexType q : index_image) {
+		const IndexType z = q / frame;
+		for (int j = first[z]; j <= last[z]; ++j)
+			slab_index[j].push_back(q - geometry[j].s_begin * frame);
+	}
+	return slab_index;
+}
+
+// Same as PO_3D on the planes [z_begin, z_end) of Output only, so that an
+// orientation can be split between threads. A path of length L through a
+// voxel stays within L-1 planes of it, the PO is run on the extended slab
+// (the cut planes being a border of the slab), with slab_index its sorted
+// indices (PO_slab_indices), and its planes [z_begin, z_end) are copied in
+// Output. Returns the number of voxels of the extended slab.
+template<typename T, typename MaskType>
+std::size_t PO_3D_slab(const Image3D<T> &image,
+		int L,
+		const std::vector<IndexType> &slab_index,
+		const std::vector<int> &orientations,
+		Image3D<T> &Output,
+		const std::vector<bool> &b,
+		const PO_Slab &slab)
+
+{
+	const IndexType frame = (IndexType) image.dimX() * image.dimY();
+
+	Image3D<T> extended(image.dimX(), image.dimY(), slab.s_end - slab.s_begin, uninitialized);
+	std::copy(image.get_pointer() + slab.s_begin * frame, image.get_pointer() + slab.s_end * frame,
+			  extended.get_pointer());
+
+	std::vector<bool> slab_b(b.begin() + slab.s_begin * frame, b.begin() + slab.s_end * frame);
+	if (slab.s_begin > 0)
+		std::fill(slab_b.begin(), slab_b.begin() + frame, false);
+	if (slab.s_end < (IndexType) image.dimZ())
+		std::fill(slab_b.end() - frame, slab_b.end(), false);
+
+	// The slab is its own output, PO_3D only reads the dimensions of image
+	PO_3D<T, MaskType>(extended, L, slab_index, orientations, extended, std::move(slab_b));
+
+	std::copy(extended.get_pointer() + (slab.z_begin - slab.s_begin) * frame,
+			  extended.get_pointer() + (slab.z_end - slab.s_begin) * frame,
+			  Output.get_pointer() + slab.z_begin * frame);
+	return extended.size();
+}
+
+// Same as PO_3D with the state arrays in the bricked layout "layout".
+// index_image and b are given in the bricked layout, Output in the linear
+// layout, brick_to_linear (BrickLayout::linear_indices) maps the two.
+template<typename T, typename MaskType>
+void PO_3D(const BrickLayout &layout,
+		int L,
+		const std::vector<IndexType> &index_image,
+		const std::vector<int> &orientations,
+		Image3D<T> &Output,
+		std::vector<bool> b,
+		const std::vector<IndexType> &brick_to_linear)
+
+{
+	std::vector<std::array<int,3>>np;
+	std::vector<std::array<int,3>>nm;
+    create_neighbourhood_shifts(orientations, np, nm);
+
+    PO_3D_layout(layout.size(), L, index_image,
+                 BrickNeighbourhood(layout, np), BrickNeighbourhood(layout, nm),
+                 [&brick_to_linear](IndexType q) { return brick_to_linear[q]; }, Output, b);
+}
+
+// Same as PO_3D for a diagonal orientation, run on a copy of the volume
+// sheared by SkewLayout so that the orientation becomes axis-aligned.
+// Output is sheared, opened and sheared back. The sheared arrays are about
+// (1 + dimZ/dimX) * (1 + dimZ/dimY) times larger than the volume.
+template<typename T, typename MaskType>
+void PO_3D_skewed(const Image3D<T> &image,
+		int L,
+		const std::vector<IndexType> &index_image,
+		const std::vector<int> &orientations,
+		Image3D<T> &Output,
+		const std::vector<bool> &b)
+
+{
+	SkewLayout skew(image.dimX(), image.dimY(), image.dimZ(), orientations);
+
+	std::vector<std::array<int,3>>up;
+	std::vector<std::array<int,3>>down;
+	create_neighbourhood_shifts(orientations, up, down);
+
+	std::vector<IndexType>np;
+	std::vector<IndexType>nm;
+	for (const std::array<int,3> &shift : up)
+		np.push_back(skew.offset(shift[0], shift[1], shift[2]));
+	for (const std::array<int,3> &shift : down)
+		nm.push_back(skew.offset(shift[0], shift[1], shift[2]));
+
+	// The padding of the sheared output is never read (b is 0 there)
+	Image3D<T> skewedOutput(skew.dimX(), skew.dimY(), skew.dimZ(), uninitialized);
+	skew.shear(Output.get_pointer(), skewedOutput.get_pointer());
+	std::vector<bool> skewed_b(skew.size(), false);
+	skew.shear(b, skewed_b);
+
+	PO_3D_layout(skew.size(), L, skew.from_linear(index_image),
+				 LinearNeighbourhood(np), LinearNeighbourhood(nm),
+				 [](IndexType q) { return q; }, skewedOutput, skewed_b);
+
+	skew.unshear(skewedOutput.get_pointer(), Output.get_pointer());
+}
+
 
 #endif // PO_INCLUDED
@@ -0,0 +1,169 @@
+/* Copyright (C) 2014 Odyssee Merveille
+odyssee.merveille@gmail.com
+
+    This software is a computer program whose purpose is to compute RORPO.
+    This software is governed by the CeCILL-B license under French law and
+    abiding by the rules of distribution of free software.  You can  use,
+    modify and/ or redistribute the software under the terms of the CeCILL-B
+    license as circulated by CEA, CNRS and INRIA at the following URL
+    "http://www.cecill.info".
+
+    As a counterpart to the access to the source code and  rights to copy,
+    modify and redistribute granted by the license, users are provided only
+    with a limited warranty  and the software's author,  the holder of the
+    economic rights,  and the successive licensors  have only  limited
+    liability.
+
+    In this respect, the user's attention is drawn to the risks associated
+    with loading,  using,  modifying and/or developing or reproducing the
+    software by the user in light of its specific status of free software,
+    that may mean  that it is complicated to manipulate,  and  that  also
+    therefore means  that it is reserved for developers  and  experienced
+    professionals having in-depth computer knowledge. Users are therefore
+    encouraged to load and test the software's suitability as regards their
+    requirements in conditions enabling the security of their systems and/or
+    data to be ensured and,  more generally, to use and operate it in the
+    same conditions as regards security.
+
+    The fact that you are presently reading this means that you have had
+    knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#ifndef PO_COST_MODEL_INCLUDED
+#define PO_COST_MODEL_INCLUDED
+
+#include <cstddef>
+#include <mutex>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+#include "RORPO/PO.hpp"
+
+// Estimated duration of the Path Opening of each orientation of RPO (0 to 6,
+// in the order of RPO_orientations), used to start the longest orientations
+// first and to split them when threads would wait.
+// The estimate is voxels * prior(o, L) * rate(layout, o): the prior gives the
+// relative cost of the orientations (measured on noisy volumes, the strides
+// along z and y are slower than x and the diagonals grow with L), the rate is
+// corrected after each PO by the measured duration.
+class PO_Cost_Model {
+
+public :
+
+	static PO_Cost_Model& instance() {
+		static PO_Cost_Model model;
+		return model;
+	}
+
+	// Estimated seconds of the PO of orientation o on state arrays of
+	// "voxels" voxels
+	double estimate(int o, PO_Layout layout, std::size_t voxels, int L) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return voxels * prior(o, L) * m_rate[(int) layout][o];
+	}
+
+	// Measured duration of a PO (or of a slab of a PO, see PO_3D_slab)
+	void record(int o, PO_Layout layout, std::size_t voxels, int L, double seconds) {
+		if (voxels == 0)
+			return;
+		const double rate = seconds / (voxels * prior(o, L));
+		std::lock_guard<std::mutex> lock(m_mutex);
+		double &r = m_rate[(int) layout][o];
+		r = m_bMeasured[(int) layout][o] ? (r + rate) / 2 : rate;
+		m_bMeasured[(int) layout][o] = true;
+	}
+
+	// Number of slabs (see PO_3D_slab) of each orientation, from the list
+	// schedule of the orientations on nb_core workers, highest priority first
+	// as in Task_Graph (a slab has the priority cost / slabs). The splittable
+	// orientations which end after total / nb_core, the end of a balanced
+	// schedule, leave the other workers idle at the tail: the last ones to end
+	// are split, all in the same number of slabs (at most max_slabs), as many
+	// of them and in as many slabs as end the schedule first, if it ends
+	// earlier. The slabs of an orientation cost overlap * cost more per cut.
+	static std::array<int, 7> split(const std::array<double, 7> &cost, const std::array<bool, 7> &splittable,
+									int nb_core, int max_slabs, double overlap) {
+		std::array<int, 7> slabs;
+		slabs.fill(1);
+		max_slabs = std::min(max_slabs, nb_core);
+		if (max_slabs < 2)
+			return slabs;
+
+		double total = 0;
+		for (double c : cost)
+			total += c;
+		std::array<double, 7> end;
+		double best = schedule(cost, slabs, nb_core, overlap, end);
+
+		// Orientations ending after the balanced schedule, last first
+		std::vector<int> tail;
+		for (int o = 0; o < 7; ++o)
+			if (splittable[o] && end[o] > total / nb_core * (1 + 1e-9))
+				tail.push_back(o);
+		std::stable_sort(tail.begin(), tail.end(), [&end](int a, int b) { return end[a] > end[b]; });
+
+		const std::array<int, 7> whole = slabs;
+		for (std::size_t m = 1; m <= tail.size(); ++m)
+			for (int k = 2; k <= max_slabs; ++k) {
+				std::array<int, 7> candidate = whole;
+				for (std::size_t j = 0; j < m; ++j)
+					candidate[tail[j]] = k;
+				std::array<double, 7> candidate_end;
+				const double makespan = schedule(cost, candidate, nb_core, overlap, candidate_end);
+				if (makespan < best) {
+					best = makespan;
+					slabs = candidate;
+				}
+			}
+		return slabs;
+	}
+
+private :
+
+	// End of the list schedule of the orientations, in slabs, on nb_core
+	// workers, and end[o] the end of the last slab of orientation o
+	static double schedule(const std::array<double, 7> &cost, const std::array<int, 7> &slabs,
+						   int nb_core, double overlap, std::array<double, 7> &end) {
+		struct Task {
+			double priority;
+			double duration;
+			int o;
+		};
+		std::vector<Task> tasks;
+		for (int o = 0; o < 7; ++o)
+			for (int j = 0; j < slabs[o]; ++j)
+				tasks.push_back({cost[o] / slabs[o],
+								 (cost[o] + overlap * cost[o] * (slabs[o] - 1)) / slabs[o], o});
+		std::stable_sort(tasks.begin(), tasks.end(),
+						 [](const Task &a, const Task &b) { return a.priority > b.priority; });
+
+		std::vector<double> workers(nb_core, 0.0);
+		end.fill(0.0);
+		for (const Task &task : tasks) {
+			double &worker = *std::min_element(workers.begin(), workers.end());
+			worker += task.duration;
+			end[task.o] = std::max(end[task.o], worker);
+		}
+		return *std::max_element(workers.begin(), workers.end());
+	}
+
+	PO_Cost_Model() {
+		for (int l = 0; l < 3; ++l)
+			for (int o = 0; o < 7; ++o) {
+				m_rate[l][o] = 1e-6;
+				m_bMeasured[l][o] = false;
+			}
+	}
+
+	static double prior(int o, int L) {
+		static const double axis[3] = {1.2, 1.05, 1.0};
+		return o < 3 ? axis[o] : 1.0 + L / 160.0;
+	}
+
+	std::mutex m_mutex;
+	double m_rate[3][7];
+	bool m_bMeasured[3][7];
+};
+
+#endif // PO_COST_MODEL_INCLUDED
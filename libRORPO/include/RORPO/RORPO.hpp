@@ -36,6 +36,9 @@ odyssee.merveille@gmail.com
 #include <string.h>
 #include <string>
 #include <vector>
+#include <array>
+#include <memory>
+#include <type_traits>
 #include <queue>
 #include <algorithm>
 #include <omp.h>
@@ -44,254 +47,293 @@ odyssee.merveille@gmail.com
 
 #include "RORPO/sorting.hpp"
 #include "RORPO/Algo.hpp"
+#include "RORPO/DirectionCodes.hpp"
 #include "RORPO/Geodilation.hpp"
+#include "RORPO/TaskGraph.hpp"
 #include "RORPO/RPO.hpp"
 
 
-template<typename T, typename MaskType>
-Image3D<T> RORPO(const Image3D<T> &image, int L, int nbCores, int dilationSize, Image3D<MaskType> &mask, std::shared_ptr<std::vector<int>> directions = nullptr) {
+// Orientations of interest of a voxel (bit o set for the orientation o), i.e.
+// the 1 to 3 orientations of largest RPO which minimize the sum of the
+// standard deviations of the two groups (orientations of interest / others).
+// values[o * os] is the response of the orientation o.
+// Branchless and without allocation: the orientations are ranked by counting
+// (decreasing RPO, ties in increasing orientation order), the sorted values
+// come from the min/max network, and the orientations of interest are those
+// whose rank is at most the number of orientations of interest.
+// The fixed-size loops are unrolled so that the arrays stay in registers.
+template<typename T>
+inline unsigned int RORPO_interest_orientations(const T* responses, std::ptrdiff_t os) {
+
+    T values[7];
+    for (int o = 0; o < 7; o++)
+        values[o] = responses[o * os];
+
+    // Rank of each orientation by decreasing RPO value ----
+    int rank[7];
+    #pragma GCC unroll 7
+    for (int o = 0; o < 7; o++) {
+        int r = 0;
+        #pragma GCC unroll 7
+        for (int p = 0; p < 7; p++)
+            r += (values[o] < values[p]) | ((values[o] == values[p]) & (p < o));
+        rank[o] = r;
+    }
+
+    // RPO values by decreasing order ----------------------
+    T pixel[7];
+    {
+        T a0 = values[0], a1 = values[1], a2 = values[2], a3 = values[3], a4 = values[4], a5 = values[5], a6 = values[6];
+        sort7_network(a0, a1, a2, a3, a4, a5, a6);
+        pixel[0] = a6; pixel[1] = a5; pixel[2] = a4; pixel[3] = a3;
+        pixel[4] = a2; pixel[5] = a1; pixel[6] = a0;
+    }
+
+    // Compute Std and find orientations of interest --------
+    // (1, 2 or 3 orientations of interest, the first minimum is kept)
+    float stdSum[3] = {
+        computeSTD_array<1>(pixel) + computeSTD_array<6>(pixel + 1),
+        computeSTD_array<2>(pixel) + computeSTD_array<5>(pixel + 2),
+        computeSTD_array<3>(pixel) + computeSTD_array<4>(pixel + 3)
+    };
+
+    float stdMin = 99999999;
+    int interestNb = 0;
+    for (int k = 0; k < 3; k++) {
+        interestNb = stdSum[k] < stdMin ? k : interestNb;
+        stdMin = stdSum[k] < stdMin ? stdSum[k] : stdMin;
+    }
+
+    unsigned int set = 0;
+    #pragma GCC unroll 7
+    for (int o = 0; o < 7; o++)
+        set |= (unsigned int) (rank[o] <= interestNb) << o;
+    return set;
+}
 
-    // ############################# RPO  ######################################
 
-    // the 7 RPO images with a 2-pixel border
-    Image3D<T> RPO1(image.dimX() + 4, image.dimY() + 4, image.dimZ() + 4, 2);
-    Image3D<T> RPO2(image.dimX() + 4, image.dimY() + 4, image.dimZ() + 4, 2);
-    Image3D<T> RPO3(image.dimX() + 4, image.dimY() + 4, image.dimZ() + 4, 2);
-    Image3D<T> RPO4(image.dimX() + 4, image.dimY() + 4, image.dimZ() + 4, 2);
-    Image3D<T> RPO5(image.dimX() + 4, image.dimY() + 4, image.dimZ() + 4, 2);
-    Image3D<T> RPO6(image.dimX() + 4, image.dimY() + 4, image.dimZ() + 4, 2);
-    Image3D<T> RPO7(image.dimX() + 4, image.dimY() + 4, image.dimZ() + 4, 2);
+// Direction code (see DirectionCodes.hpp) of each voxel, handed to
+// store(i, code). Only the voxels i for which selected(i) is true are
+// estimated, the others get the null direction.
+template<typename T, typename Select, typename Store>
+void RORPO_direction_codes(const OrientationResponses<T> &responses, Select selected, Store store) {
 
-    auto orientationsRPO = RPO(image, L, RPO1, RPO2, RPO3, RPO4, RPO5, RPO6, RPO7, nbCores, dilationSize, mask);
+    const Direction_Codes& table = Direction_Codes::instance();
+    const T* data = responses.get_pointer();
+    const std::ptrdiff_t os = responses.orientation_stride();
+    const std::ptrdiff_t vs = responses.voxel_stride();
 
-    // ################### Limit Orientations Treatment #######################
+    // The selected voxels are clustered (vessels), hence the dynamic schedule
+    #pragma omp parallel for schedule(dynamic, 4096)
+    for (std::ptrdiff_t i = 0; i < (std::ptrdiff_t) responses.size(); i++)
+        store(i, selected(i) ? table.code(RORPO_interest_orientations(data + i * vs, os)) : (uint8_t) 0);
+}
 
-    // ------------------------- Computation of Imin --------------------------
-
-    // ---- Imin limit case 4 orientations ----
-
-    Image3D<T> Imin4(image.dimX(), image.dimY(), image.dimZ());
-
-    //6 combinations for pattern 1
-    //c1: horizontal + vertical + diag1 + diag4
-    Image3D<T> Imin4_1 = RPO1.copy_image();
-    min_crush(Imin4_1, RPO2);
-    min_crush(Imin4_1, RPO4);
-    min_crush(Imin4_1, RPO7);
-    max_crush(Imin4, Imin4_1);
-    Imin4_1.clear_image();
-
-    //c2: horizontal + vertical + diag2 + diag3
-    Image3D<T> Imin4_2 = RPO1.copy_image();
-    min_crush(Imin4_2, RPO2);
-    min_crush(Imin4_2, RPO5);
-    min_crush(Imin4_2, RPO6);
-    max_crush(Imin4, Imin4_2);
-    Imin4_2.clear_image();
-
-    //c3: horizontal + profondeur + diag2+ diag4
-    Image3D<T> Imin4_3 = RPO1.copy_image();
-    min_crush(Imin4_3, RPO3);
-    min_crush(Imin4_3, RPO5);
-    min_crush(Imin4_3, RPO7);
-    max_crush(Imin4, Imin4_3);
-    Imin4_3.clear_image();
-
-    //c4: horizontal + profondeur + diag1+ diag3
-    Image3D<T> Imin4_4 = RPO1.copy_image();
-    min_crush(Imin4_4, RPO3);
-    min_crush(Imin4_4, RPO4);
-    min_crush(Imin4_4, RPO6);
-    max_crush(Imin4, Imin4_4);
-    Imin4_4.clear_image();
-
-    //c5: vertical + profondeur + diag3+ diag4
-    Image3D<T> Imin4_5 = RPO2.copy_image();
-    min_crush(Imin4_5, RPO3);
-    min_crush(Imin4_5, RPO6);
-    min_crush(Imin4_5, RPO7);
-    max_crush(Imin4, Imin4_5);
-    Imin4_5.clear_image();
-
-    //c6: vertical + profondeur + diag1+ diag2
-    Image3D<T> Imin4_6 = RPO2.copy_image();
-    min_crush(Imin4_6, RPO3);
-    min_crush(Imin4_6, RPO4);
-    min_crush(Imin4_6, RPO5);
-    max_crush(Imin4, Imin4_6);
-    Imin4_6.clear_image();
-
-    //4 combinations for pattern 2
-    //c7: horizontal + vertical + profondeur + diag1
-    Image3D<T> Imin4_7 = RPO1.copy_image();
-    min_crush(Imin4_7, RPO2);
-    min_crush(Imin4_7, RPO3);
-    min_crush(Imin4_7, RPO4);
-    max_crush(Imin4, Imin4_7);
-    Imin4_7.clear_image();
-
-    //c8: horizontal + vertical + profondeur + diag2
-    Image3D<T> Imin4_8 = RPO1.copy_image();
-    min_crush(Imin4_8, RPO2);
-    min_crush(Imin4_8, RPO3);
-    min_crush(Imin4_8, RPO5);
-    max_crush(Imin4, Imin4_8);
-    Imin4_8.clear_image();
-
-    //c9: horizontal + vertical + profondeur + diag3
-    Image3D<T> Imin4_9 = RPO1.copy_image();
-    min_crush(Imin4_9, RPO2);
-    min_crush(Imin4_9, RPO3);
-    min_crush(Imin4_9, RPO6);
-    max_crush(Imin4, Imin4_9);
-    Imin4_9.clear_image();
-
-    //c10: horizontal + vertical + profondeur + diag4
-    Image3D<T> Imin4_10 = RPO1.copy_image();
-    min_crush(Imin4_10, RPO2);
-    min_crush(Imin4_10, RPO3);
-    min_crush(Imin4_10, RPO7);
-    max_crush(Imin4, Imin4_10);
-    Imin4_10.clear_image();
-
-    // ---- Imin limit case 5 orientations ----
-    Image3D<T> Imin5 = RPO4.copy_image();
-    min_crush(Imin5, RPO5);
-    min_crush(Imin5, RPO6);
-    min_crush(Imin5, RPO7);
 
+// Direction of each voxel, 3 ints per voxel: sum of the orientations of interest
+template<typename T, typename Select>
+void RORPO_directions(const OrientationResponses<T> &responses, std::vector<int> &directions, Select selected) {
+    const Direction_Codes& table = Direction_Codes::instance();
+    int* out = directions.data();
+    RORPO_direction_codes(responses, selected, [&](std::ptrdiff_t i, uint8_t code) {
+        const std::array<int, 3>& v = table.vector(code);
+        out[i * 3] = v[0];
+        out[i * 3 + 1] = v[1];
+        out[i * 3 + 2] = v[2];
+    });
+}
 
-    // ############### Sorting RPO orientations ################################
+// Direction of each voxel, 1 byte per voxel: see DirectionCodes.hpp to expand them
+template<typename T, typename Select>
+void RORPO_directions(const OrientationResponses<T> &responses, std::vector<uint8_t> &directions, Select selected) {
+    uint8_t* out = directions.data();
+    RORPO_direction_codes(responses, selected, [&](std::ptrdiff_t i, uint8_t code) {
+        out[i] = code;
+    });
+}
 
-    Image3D<T> RPOt1 = RPO1.copy_image();
-    Image3D<T> RPOt2 = RPO2.copy_image();
-    Image3D<T> RPOt3 = RPO3.copy_image();
-    Image3D<T> RPOt4 = RPO4.copy_image();
-    Image3D<T> RPOt5 = RPO5.copy_image();
-    Image3D<T> RPOt6 = RPO6.copy_image();
-    Image3D<T> RPOt7 = RPO7.copy_image();
-
-    // Clear Images which are non useful anymore
-    RPO1.clear_image();
-    RPO2.clear_image();
-    RPO3.clear_image();
-    RPO4.clear_image();
-    RPO5.clear_image();
-    RPO6.clear_image();
-    RPO7.clear_image();
+template<typename T, typename DirectionType>
+void RORPO_directions(const OrientationResponses<T> &responses, std::vector<DirectionType> &directions) {
+    RORPO_directions(responses, directions, [](std::ptrdiff_t) { return true; });
+}
 
-    // ######################## Compute directions ############################
 
-    // ------------------------ Pointwise Rank Filter -------------------------
-
-    if (directions) {
-        for (size_t i = 0; i < orientationsRPO[0].size(); i++) {
-
-            // Pointwise Rank Filter --------------------------------
-            std::vector<std::pair<T, int>> pixel{
-                std::make_pair(RPOt1(i), 0),
-                std::make_pair(RPOt2(i), 1),
-                std::make_pair(RPOt3(i), 2),
-                std::make_pair(RPOt4(i), 3),
-                std::make_pair(RPOt5(i), 4),
-                std::make_pair(RPOt6(i), 5),
-                std::make_pair(RPOt7(i), 6)
-            };
-
-            std::sort(pixel.begin(), pixel.end(),
-                [&](const auto& a, const auto& b) {
-                    return a.first > b.first;
-                });
+// Directions output of RORPO: 3 ints per voxel (DirectionType = int) or one
+// direction code per voxel (DirectionType = uint8_t, see DirectionCodes.hpp).
+// DirectionType is not deduced (so that nullptr can be given), it is given
+// with the template arguments: RORPO<T, MaskType, uint8_t>(...).
+template<typename DirectionType>
+using Directions_Output = typename std::enable_if<true, std::shared_ptr<std::vector<DirectionType>>>::type;
 
-            float stdMin = 99999999;
-            int interestNb = 0; 
-            
-            // Compute Std and find orientations of interest --------
-            for (size_t k = 0; k < 3; k++) {
-                float stdP = computeSTD(pixel.begin(), pixel.begin() + k + 1);
-                float stdO = computeSTD(pixel.begin() + k + 1, pixel.end());
-
-                float stdSum = stdP + stdO;
-
-                if (stdSum < stdMin) {
-                    stdMin = stdSum;
-                    interestNb = k;
-                }
-            }
-
-            std::array<std::vector<int>, 7> orientations = {
-                    std::vector<int>{1, 0, 0},//1
-                    std::vector<int>{0, 1, 0},//2
-                    std::vector<int>{0, 0, 1},//3
-                    std::vector<int>{1, 1, 1},//4
-                    std::vector<int>{1, 1, -1},//5
-                    std::vector<int>{-1, 1, 1},//6
-                    std::vector<int>{-1, 1, -1},//7
-            };
-
-            // Combine orientations of interest to find direction ---
-            std::vector<int> direction = orientations[pixel[0].second];
-            for (size_t j = 1; j <= interestNb; j++) {
-                std::transform(direction.begin(), direction.end(), orientations[pixel[j].second].begin(),
-                    direction.begin(), std::plus<int>());
-            }
-
-            std::copy(direction.begin(), direction.end(), directions->begin() + i * 3);
-        }
-    } // directions
 
-    // Pointwise rank filter
-    std::vector<std::array<uint8_t, 7>> o_indices(RPOt1.size()); //orientation indices
-    sorting(RPOt1, RPOt2, RPOt3, RPOt4, RPOt5, RPOt6, RPOt7, RPOt1.size(), o_indices);
+// Voxels where RORPO estimates the directions, a null direction is written
+// elsewhere. By default all the voxels are estimated; on angiographies most of
+// the volume is background where the direction is meaningless.
+struct Directions_Domain {
+    // Only the voxels whose RORPO response is greater than threshold
+    bool use_threshold = false;
+    double threshold = 0;
+    // Only the voxels inside the mask (non-zero)
+    bool inside_mask = false;
+};
+
 
-    // Clear Images which are non useful anymore
-    RPOt1.clear_image();
-    RPOt5.clear_image();
-    RPOt6.clear_image();
+// RORPO from the responses of the 7 orientations of the RPO, with nb_core
+// threads. mask is only used by the directions domain.
+template<typename T, typename MaskType = uint8_t, typename DirectionType = int>
+Image3D<T> RORPO(const OrientationResponses<T> &responses, int nb_core, Directions_Output<DirectionType> directions = nullptr,
+                 const Directions_Domain &domain = Directions_Domain(),
+                 const Image3DConstView<MaskType> &mask = Image3DConstView<MaskType>()) {
+
+    const unsigned int dimX = responses.dimX();
+    const unsigned int dimY = responses.dimY();
+    const unsigned int dimZ = responses.dimZ();
+
+    // ################### Limit Orientations Treatment #######################
+    // ############### Sorting RPO orientations ################################
+
+    Image3D<T> Imin4, Imin5, RPOt2, RPOt3, RPOt4, RPOt7;
+    Image3D<T> RORPO_res, RPO5_geo, RPO6_geo;
+
+    const bool use_mask = domain.inside_mask && !mask.empty();
+    if (directions && domain.inside_mask && mask.empty())
+        std::cout << "Warning in RORPO.hpp : no mask, the directions are not restricted to it" << std::endl;
+
+    // Each stage declares the images it reads and writes: the difference, the
+    // two geodesic reconstructions and the directions (without threshold) run
+    // concurrently, and each image is freed after its last reader
+    Task_Graph graph;
+    const Task_Graph::Buffer imin4_buffer = graph.buffer([&]() { Imin4.clear_image(); });
+    const Task_Graph::Buffer imin5_buffer = graph.buffer([&]() { Imin5.clear_image(); });
+    const Task_Graph::Buffer rpot2_buffer = graph.buffer([&]() { RPOt2.clear_image(); });
+    const Task_Graph::Buffer rpot3_buffer = graph.buffer([&]() { RPOt3.clear_image(); });
+    const Task_Graph::Buffer rpot4_buffer = graph.buffer([&]() { RPOt4.clear_image(); });
+    const Task_Graph::Buffer rpot7_buffer = graph.buffer([&]() { RPOt7.clear_image(); });
+    const Task_Graph::Buffer rpo5_geo_buffer = graph.buffer([&]() { RPO5_geo.clear_image(); });
+    const Task_Graph::Buffer rpo6_geo_buffer = graph.buffer([&]() { RPO6_geo.clear_image(); });
+    const Task_Graph::Buffer diff_buffer = graph.buffer();
+    const Task_Graph::Buffer rorpo_buffer = graph.buffer();
+
+    // Imin of the limit cases and pointwise rank filter, in a single pass over
+    // the responses (one stream with the interleaved layout)
+    graph.task([&]() {
+        Imin4 = Image3D<T>(dimX, dimY, dimZ, uninitialized);
+        Imin5 = Image3D<T>(dimX, dimY, dimZ, uninitialized);
+        RPOt2 = Image3D<T>(dimX, dimY, dimZ, uninitialized);
+        RPOt3 = Image3D<T>(dimX, dimY, dimZ, uninitialized);
+        RPOt4 = Image3D<T>(dimX, dimY, dimZ, uninitialized);
+        RPOt7 = Image3D<T>(dimX, dimY, dimZ, uninitialized);
+
+        const T* data = responses.get_pointer();
+        const std::ptrdiff_t os = responses.orientation_stride();
+        const std::ptrdiff_t vs = responses.voxel_stride();
+
+        T* imin4 = Imin4.get_pointer();
+        T* imin5 = Imin5.get_pointer();
+        T* rank2 = RPOt2.get_pointer();
+        T* rank3 = RPOt3.get_pointer();
+        T* rank4 = RPOt4.get_pointer();
+        T* rank7 = RPOt7.get_pointer();
+
+        #pragma omp parallel for simd
+        for (std::ptrdiff_t i = 0; i < (std::ptrdiff_t) responses.size(); i++) {
+            const T* v = data + i * vs;
+            T r1 = v[0], r2 = v[os], r3 = v[2 * os], r4 = v[3 * os], r5 = v[4 * os], r6 = v[5 * os], r7 = v[6 * os];
+
+            // ---- Imin limit case 4 orientations ----
+            T m = 0;
+            //6 combinations for pattern 1
+            m = std::max(m, std::min(std::min(std::min(r1, r2), r4), r7)); //c1: horizontal + vertical + diag1 + diag4
+            m = std::max(m, std::min(std::min(std::min(r1, r2), r5), r6)); //c2: horizontal + vertical + diag2 + diag3
+            m = std::max(m, std::min(std::min(std::min(r1, r3), r5), r7)); //c3: horizontal + profondeur + diag2+ diag4
+            m = std::max(m, std::min(std::min(std::min(r1, r3), r4), r6)); //c4: horizontal + profondeur + diag1+ diag3
+            m = std::max(m, std::min(std::min(std::min(r2, r3), r6), r7)); //c5: vertical + profondeur + diag3+ diag4
+            m = std::max(m, std::min(std::min(std::min(r2, r3), r4), r5)); //c6: vertical + profondeur + diag1+ diag2
+            //4 combinations for pattern 2
+            m = std::max(m, std::min(std::min(std::min(r1, r2), r3), r4)); //c7: horizontal + vertical + profondeur + diag1
+            m = std::max(m, std::min(std::min(std::min(r1, r2), r3), r5)); //c8: horizontal + vertical + profondeur + diag2
+            m = std::max(m, std::min(std::min(std::min(r1, r2), r3), r6)); //c9: horizontal + vertical + profondeur + diag3
+            m = std::max(m, std::min(std::min(std::min(r1, r2), r3), r7)); //c10: horizontal + vertical + profondeur + diag4
+            imin4[i] = m;
+
+            // ---- Imin limit case 5 orientations ----
+            imin5[i] = std::min(std::min(std::min(r4, r5), r6), r7);
+
+            // Pointwise rank filter
+            rank7_network(r1, r2, r3, r4, r5, r6, r7);
+            rank2[i] = r2;
+            rank3[i] = r3;
+            rank4[i] = r4;
+            rank7[i] = r7;
+        }
+    }, {}, {imin4_buffer, imin5_buffer, rpot2_buffer, rpot3_buffer, rpot4_buffer, rpot7_buffer}, true);
 
     // Compute RORPO without limit orientations
-    Image3D<T> RORPO_res = diff(RPOt7, RPOt4);
-    RPOt7.clear_image();
+    graph.task([&]() {
+        RORPO_res = diff(RPOt7, RPOt4);
+    }, {rpot7_buffer, rpot4_buffer}, {diff_buffer}, true);
 
 
     // ----------------------- Computation of Imin2 ----------------------------
     //geodesic reconstruction of RPO6 in RPO4
-    Image3D<T> RPO6_geo = geodilation(RPOt2, RPOt4, 18, -1);
-    RPOt2.clear_image();
+    graph.task([&]() {
+        RPO6_geo = geodilation(RPOt2, RPOt4, 18, -1);
+    }, {rpot2_buffer, rpot4_buffer}, {rpo6_geo_buffer});
 
     //geodesic reconstruction of RPO5 in RPO4
-    Image3D<T> RPO5_geo = geodilation(RPOt3, RPOt4, 18, -1);;
-    RPOt3.clear_image();
-    RPOt4.clear_image();
+    graph.task([&]() {
+        RPO5_geo = geodilation(RPOt3, RPOt4, 18, -1);
+    }, {rpot3_buffer, rpot4_buffer}, {rpo5_geo_buffer});
 
-    // ---- Imin2 limit case 4 orientations ----
-    Image3D<T> Imin2_4 = Imin4.copy_image();
-    min_crush(Imin2_4, RPO5_geo);
-    RPO5_geo.clear_image();
 
+    // --------------------------- Final Result --------------------------------
 
-    // ---- Imin2 limit case 5 orientations ----
-    Image3D<T> Imin2_5 = Imin5.copy_image();
-    min_crush(Imin2_5, RPO6_geo);
+    // Imin2 limit case 4 orientations: min(Imin4, RPO5_geo)
+    // Imin2 limit case 5 orientations: min(Imin5, RPO6_geo)
+    // computed with the differences and the maximum in a single pass
+    graph.task([&]() {
+        RORPO_res = expr_max(expr_max(RORPO_res, expr_diff(Imin4, expr_min(Imin4, RPO5_geo))),
+                             expr_diff(Imin5, expr_min(Imin5, RPO6_geo)));
+    }, {diff_buffer, imin4_buffer, imin5_buffer, rpo5_geo_buffer, rpo6_geo_buffer}, {rorpo_buffer}, true);
 
-    RPO6_geo.clear_image();
+    // ######################## Compute directions ############################
 
+    // The threshold of the domain is on the RORPO response, the directions
+    // then wait for the final result
+    if (directions)
+        graph.task([&]() {
+            if (!domain.use_threshold && !use_mask)
+                RORPO_directions(responses, *directions);
+            else
+                RORPO_directions(responses, *directions, [&](std::ptrdiff_t i) {
+                    if (domain.use_threshold && !(RORPO_res(i) > domain.threshold))
+                        return false;
+                    if (use_mask)
+                        return mask(i % dimX, (i / dimX) % dimY, i / ((std::ptrdiff_t) dimX * dimY)) != 0;
+                    return true;
+                });
+        }, domain.use_threshold ? std::vector<Task_Graph::Buffer>{rorpo_buffer} : std::vector<Task_Graph::Buffer>{},
+        {}, true);
 
-    // --------------------------- Final Result --------------------------------
+    graph.run(nb_core);
 
-    Image3D<T> Diff_Imin4 = diff(Imin4, Imin2_4);
-    Image3D<T> Diff_Imin5 = diff(Imin5, Imin2_5);
+    return RORPO_res;
+
+}
 
-    Imin4.clear_image();
-    Imin2_4.clear_image();
-    Imin5.clear_image();
-    Imin2_5.clear_image();
 
-    max_crush(RORPO_res, Diff_Imin4);
-    max_crush(RORPO_res, Diff_Imin5);
+template<typename T, typename MaskType, typename DirectionType = int>
+Image3D<T> RORPO(const Image3DConstView<T> &image, int L, int nbCores, int dilationSize, const Image3DConstView<MaskType> &mask, Directions_Output<DirectionType> directions = nullptr, PO_Layout layout = PO_Layout::Linear,
+                 Responses_Layout responses_layout = Responses_Layout::Planar,
+                 const Directions_Domain &directions_domain = Directions_Domain()) {
 
-    return RORPO_res;
+    // ############################# RPO  ######################################
+
+    OrientationResponses<T> responses(image.dimX(), image.dimY(), image.dimZ(), responses_layout);
+
+    RPO<T, MaskType>(image, L, responses, nbCores, dilationSize, mask, layout);
 
+    return RORPO<T, MaskType, DirectionType>(responses, nbCores, directions, directions_domain, mask);
 }
 
 #endif // RORPO_INCLUDED
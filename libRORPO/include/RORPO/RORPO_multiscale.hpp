@@ -36,52 +36,258 @@ odyssee.merveille@gmail.com
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <memory>
+#include <type_traits>
+#include <algorithm>
+#include <omp.h>
 
 #include "RORPO/pink/rect3dmm.hpp"
 #include "RORPO/RORPO.hpp"
 #include "RORPO/Algo.hpp"
 
 
-template<typename PixelType, typename MaskType>
-Image3D<PixelType> RORPO_multiscale(const Image3D<PixelType> &I,
+// Estimated peak memory (in bytes) of RORPO on a dimX x dimY x dimZ image of
+// PixelType, with nb_core threads and the Path Opening layout "layout", for
+// "scales" scales computed "concurrent" at a time. A scale holds its 7
+// responses, the dilated image with its border, the sorted indices (and the
+// pointers sorted to get them) and b, and per running orientation its output,
+// path lengths and copy of b, and in the
+// - Linear layout, with several threads, the slabs of a split orientation
+// (PO_3D_slab), which overlap by at most their own thickness, each with a
+// copy of the image, path lengths and b, and their sorted indices
+// - Skewed layout, the sheared copies (SkewLayout) of the output, path
+// lengths, indices and b of a diagonal orientation
+// - Bricked layout, the sorted indices and b converted once, and path lengths
+// and b padded to whole bricks (BrickLayout)
+// then the 9 temporary images of RORPO, which replace all but the responses.
+// When the caller enabled the buffer pool (Image_Buffer_Pool), it keeps the
+// freed images and path lengths, as many of each size as were used at the
+// same time: the two phases add up, and the slabs, whose size depends on the
+// scale, stay cached for each scale computed.
+template<typename PixelType>
+std::size_t RORPO_memory_estimate(unsigned int dimX, unsigned int dimY, unsigned int dimZ, int nb_core,
+                                  PO_Layout layout = PO_Layout::Linear,
+                                  std::size_t scales = 1, std::size_t concurrent = 1)
+{
+    const std::size_t pixel = sizeof(PixelType);
+    const std::size_t size = (std::size_t) dimX * dimY * dimZ;
+    const IndexType bdx = dimX + 4, bdy = dimY + 4, bdz = dimZ + 4;
+    const std::size_t bordered = (std::size_t) bdx * bdy * bdz;
+    const std::size_t tasks = std::min(std::max(nb_core, 1), 7);
+
+    // Path Opening phase: buffers the pool can keep (images and path lengths),
+    // and the others (indices and b), freed at the end of the phase
+    std::size_t pooled = bordered * pixel + tasks * bordered * pixel;
+    std::size_t other = bordered * (sizeof(IndexType) + sizeof(PixelType*)) + bordered / 8;
+    std::size_t slabs_per_scale = 0;
+
+    if (layout == PO_Layout::Bricked) {
+        const std::size_t bricks = BrickLayout(bdx, bdy, bdz).size();
+        pooled += tasks * bricks * 2 * sizeof(int);
+        other += bordered * sizeof(IndexType) + bricks * sizeof(IndexType) + bricks / 8 + tasks * (bricks / 8);
+    }
+    else {
+        // In the skewed layout the 4 diagonal orientations are sheared, the
+        // others are run as in the linear layout
+        const std::size_t diagonal = layout == PO_Layout::Skewed ? std::min<std::size_t>(tasks, 4) : 0;
+        const std::size_t axis = layout == PO_Layout::Skewed ? std::min<std::size_t>(tasks, 3) : tasks;
+        const std::size_t sheared = SkewLayout(bdx, bdy, bdz, {1, 1, 1}).size();
+        pooled += diagonal * sheared * (pixel + 2 * sizeof(int)) + axis * bordered * 2 * sizeof(int);
+        other += diagonal * (sheared / 8 + bordered * sizeof(IndexType));
+        if (nb_core > 1) {
+            slabs_per_scale = axis * 2 * bordered * (pixel + 2 * sizeof(int));
+            pooled += slabs_per_scale;
+            other += 2 * bordered * sizeof(IndexType) + (tasks - diagonal) * 2 * (bordered / 8);
+        }
+        else
+            other += (tasks - diagonal) * (bordered / 8);
+    }
+
+    // 7 responses and the 9 temporary images of RORPO
+    const std::size_t responses = 7 * size * pixel;
+    const std::size_t rorpo = 16 * size * pixel;
+
+    scales = std::max<std::size_t>(scales, 1);
+    concurrent = std::max<std::size_t>(1, std::min(concurrent, scales));
+    if (!Image_Buffer_Pool::instance().enabled())
+        return concurrent * std::max(responses + pooled + other, rorpo);
+    return concurrent * (rorpo + pooled + other) + (scales - concurrent) * slabs_per_scale;
+}
+
+
+// best_scale (optional): index in S_list of the scale giving the maximum, for
+// each voxel (the first one in case of equality).
+// directions (optional): directions of the best scale (3 ints or one code per
+// voxel, see Directions_Output in RORPO.hpp), estimated in directions_domain
+// (the threshold applies to the response before the contrast enhancement).
+// memory_budget (optional, in bytes): when not 0 and nb_core is larger than
+// the 7 Path Openings of one scale, several scales are computed at the same
+// time, as many as their estimated memory (RORPO_memory_estimate) fits in the
+// budget, at least one. nb_core is shared between them: it stays the total
+// number of threads.
+// The result does not depend on the order in which the scales complete.
+template<typename PixelType, typename MaskType, typename DirectionType = int>
+Image3D<PixelType> RORPO_multiscale(const Image3DConstView<PixelType> &I,
                                     const std::vector<int>& S_list,
                                     int nb_core,
                                     int dilationSize,
                                     int debug_flag,
-                                    Image3D<MaskType> &Mask)
+                                    const Image3DConstView<MaskType> &Mask,
+                                    PO_Layout layout = PO_Layout::Linear,
+                                    std::shared_ptr<std::vector<uint8_t>> best_scale = nullptr,
+                                    Directions_Output<DirectionType> directions = nullptr,
+                                    const Directions_Domain &directions_domain = Directions_Domain(),
+                                    std::size_t memory_budget = 0)
 {
+    if (S_list.empty()) {
+        std::cerr << "Error in RORPO_multiscale.hpp : no scale" << std::endl;
+        return Image3D<PixelType>();
+    }
+    if ((best_scale || directions) && S_list.size() > 256) {
+        std::cerr << "Error in RORPO_multiscale.hpp : the best scale map and the directions are limited to 256 scales" << std::endl;
+        return Image3D<PixelType>();
+    }
 
     // ################## Computation of RORPO for each scale ##################
 
-    Image3D<PixelType> Multiscale(I.dimX(), I.dimY(), I.dimZ(),I.spacingX(),I.spacingY(),I.spacingZ(),I.originX(),I.originY(),I.originZ());
+    // In debug mode, report the part of the large buffers backed by huge pages
+    Huge_Pages &huge_pages = Huge_Pages::instance();
+    const bool huge_pages_tracking = huge_pages.tracking();
+    if (debug_flag) {
+        huge_pages.reset();
+        huge_pages.track(true);
+    }
+
+    // The first scale completed is copied, the others are merged in it
+    Image3D<PixelType> Multiscale(I.dimX(), I.dimY(), I.dimZ(),I.spacingX(),I.spacingY(),I.spacingZ(),I.originX(),I.originY(),I.originZ(), uninitialized);
+    PixelType* multiscale = Multiscale.get_pointer();
+
+    const int directionWidth = std::is_same<DirectionType, uint8_t>::value ? 1 : 3;
+    if (directions)
+        directions->resize(I.size() * directionWidth);
 
-	std::vector<int>::const_iterator it;
+    // Best scale of each voxel, also needed to merge the directions: the
+    // largest response wins, then the smallest scale index
+    std::shared_ptr<std::vector<uint8_t>> best = best_scale;
+    if (directions && !best)
+        best = std::make_shared<std::vector<uint8_t>>();
+    if (best)
+        best->resize(I.size());
 
-	for (it=S_list.begin();it!=S_list.end();++it)
-	{
-        Image3D<PixelType> One_Scale =
-                RORPO<PixelType, MaskType>(I, *it, nb_core,dilationSize, Mask);
+    // Maximum of Multiscale, updated by each merge
+    PixelType max_multiscale = 0;
+    bool first_merge = true;
 
+    auto merge = [&](std::size_t s, const Image3D<PixelType> &One_Scale, Directions_Output<DirectionType> &scaleDirections) {
+        const PixelType* one = One_Scale.get_pointer();
+        const uint8_t scale = (uint8_t) s;
+
+        if (first_merge) {
+            // RORPO is positive: max(0, One_Scale) is One_Scale
+            max_multiscale = parallel_simd_for_max(I.size(), max_multiscale, [multiscale, one](std::ptrdiff_t i) {
+                multiscale[i] = one[i];
+                return one[i];
+            });
+            if (best)
+                std::fill(best->begin(), best->end(), scale);
+            if (directions)
+                directions->swap(*scaleDirections);
+            first_merge = false;
+        }
         // Max of scales
-	    max_crush(Multiscale, One_Scale);
-	}
+        else if (!best)
+            max_multiscale = parallel_simd_for_max(I.size(), max_multiscale, [multiscale, one](std::ptrdiff_t i) {
+                multiscale[i] = std::max(multiscale[i], one[i]);
+                return multiscale[i];
+            });
+        else {
+            // same pass: argmax and directions of the best scale
+            uint8_t* bestScales = best->data();
+            DirectionType* bestDirections = directions ? directions->data() : nullptr;
+            const DirectionType* oneDirections = directions ? scaleDirections->data() : nullptr;
+
+            max_multiscale = parallel_simd_for_max(I.size(), max_multiscale, [=](std::ptrdiff_t i) {
+                if (multiscale[i] < one[i] || (multiscale[i] == one[i] && scale < bestScales[i])) {
+                    multiscale[i] = one[i];
+                    bestScales[i] = scale;
+                    if (bestDirections)
+                        for (int c = 0; c < directionWidth; c++)
+                            bestDirections[i * directionWidth + c] = oneDirections[i * directionWidth + c];
+                }
+                return multiscale[i];
+            });
+        }
+    };
+
+    // RORPO at scale s, its directions in scaleDirections
+    auto one_scale = [&](std::size_t s, int scale_cores, Directions_Output<DirectionType> &scaleDirections) {
+        if (directions && !scaleDirections)
+            scaleDirections = std::make_shared<std::vector<DirectionType>>(I.size() * directionWidth);
+        return RORPO<PixelType, MaskType, DirectionType>(I, S_list[s], scale_cores, dilationSize, Mask, scaleDirections, layout,
+                                                         Responses_Layout::Planar, directions_domain);
+    };
+
+    // Number of scales computed at the same time: a scale runs at most 7 Path
+    // Openings at once, so scales are only added when each one keeps at least
+    // 7 of the nb_core threads, and while their memory fits in the budget
+    std::size_t concurrent_scales = 1;
+    if (memory_budget > 0) {
+        const std::size_t outputs = I.size() * (sizeof(PixelType) + (best ? 1 : 0) + (directions ? directionWidth * sizeof(DirectionType) : 0));
+        concurrent_scales = std::min<std::size_t>(S_list.size(), std::max(1, nb_core / 7));
+        while (concurrent_scales > 1
+               && outputs + RORPO_memory_estimate<PixelType>(I.dimX(), I.dimY(), I.dimZ(), nb_core / (int) concurrent_scales,
+                                                             layout, S_list.size(), concurrent_scales) > memory_budget)
+            --concurrent_scales;
+    }
+    // Threads of each scale, concurrent_scales * scale_cores <= nb_core
+    const int scale_cores = std::max(1, nb_core / (int) concurrent_scales);
+
+    if (concurrent_scales == 1) {
+        Directions_Output<DirectionType> scaleDirections = nullptr;
+        for (std::size_t s = 0; s < S_list.size(); ++s)
+        {
+            // One_Scale is freed at the end of the iteration, the buffer pool
+            // gives its buffer back to the next scale
+            Image3D<PixelType> One_Scale = one_scale(s, scale_cores, scaleDirections);
+            merge(s, One_Scale, scaleDirections);
+        }
+    }
+    else {
+        // Each scale runs its own team of scale_cores threads
+        const int max_active_levels = omp_get_max_active_levels();
+        omp_set_max_active_levels(std::max(max_active_levels, 2));
+
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(concurrent_scales)
+        for (std::ptrdiff_t s = 0; s < (std::ptrdiff_t) S_list.size(); ++s)
+        {
+            Directions_Output<DirectionType> scaleDirections = nullptr;
+            Image3D<PixelType> One_Scale = one_scale(s, scale_cores, scaleDirections);
+
+            #pragma omp critical(RORPO_multiscale_merge)
+            merge(s, One_Scale, scaleDirections);
+        }
+
+        omp_set_max_active_levels(max_active_levels);
+    }
 
     // ----------------- Dynamic Enhancement ---------------
-	// Find Max value of output_buffer
-	int max_value_RORPO = Multiscale.max_value();
+	// Max value of output_buffer
+	int max_value_RORPO = max_multiscale;
 	int max_value_I = I.max_value();
 
-    // Contrast Enhancement
-	for ( auto& val : Multiscale.get_data() )
-        val = (PixelType)((val / (float)max_value_RORPO ) * max_value_I);
+    // Contrast Enhancement, min with I and application of the non dilated
+    // mask to output, in a single pass
+    if (!Mask.empty()) // A mask image is given
+        Multiscale = expr_mask(expr_min(expr_scale(Multiscale, (float) max_value_RORPO, max_value_I), I), Mask);
+    else
+        Multiscale = expr_min(expr_scale(Multiscale, (float) max_value_RORPO, max_value_I), I);
 
-	min_crush(Multiscale, I);
+    if (debug_flag) {
+        std::cout << "Huge pages: " << (huge_pages.backed_bytes() >> 20) << " MB of the "
+                  << (huge_pages.accounted_bytes() >> 20) << " MB of Path Opening buffers" << std::endl;
+        huge_pages.track(huge_pages_tracking);
+    }
 
-    if (!Mask.empty()) // A mask image is given
-	{
-		// Application of the non dilated mask to output
-        mask_image<PixelType, MaskType>(Multiscale, Mask);
-	}
 	return Multiscale;
 }
 
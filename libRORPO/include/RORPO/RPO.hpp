@@ -41,67 +41,62 @@ odyssee.merveille@gmail.com
 
 
 #include "RORPO/Algo.hpp"
+#include "RORPO/Bitset3D.hpp"
 #include "Image/Image.hpp"
+#include "RORPO/IndexType.hpp"
+#include "RORPO/OrientationResponses.hpp"
 #include "RORPO/PO.hpp"
+#include "RORPO/POCostModel.hpp"
+#include "RORPO/TaskGraph.hpp"
 
-#define OMP
 
-
-template<typename T, typename MaskType>
-void Stuff_PO(Image3D<T> &dilatImageWithBorders,
-              std::vector<long> &index_image,
-              int L,
-              std::vector<bool> &b,
-              Image3D<MaskType> &Mask){
-
-
-    // Sort the grey level intensity in a vector
-    index_image = sort_image_value<T,long>(dilatImageWithBorders.get_pointer(),
-                                           dilatImageWithBorders.size());
-
-
-    int new_dimz = dilatImageWithBorders.dimZ();
-    int new_dimy = dilatImageWithBorders.dimY();
-    int new_dimx = dilatImageWithBorders.dimX();
+// b of the PO in a bordered image of new_dimx*new_dimy*new_dimz voxels: set
+// to 0 on the border, and outside the mask dilated by L/2 if there is a mask.
+// Only depends on the dimensions, not on the grey levels.
+template<typename MaskType>
+void PO_border_mask(IndexType new_dimx, IndexType new_dimy, IndexType new_dimz,
+                    int L,
+                    std::vector<bool> &b,
+                    const Image3DConstView<MaskType> &Mask){
 
     // z = 0
-    for (int y = 0; y < dilatImageWithBorders.dimY() ; ++y){
-        for (int x = 0 ; x < dilatImageWithBorders.dimX() ; ++x){
+    for (IndexType y = 0; y < new_dimy ; ++y){
+        for (IndexType x = 0 ; x < new_dimx ; ++x){
             b[y*new_dimx+x] = 0;
         }
     }
 
     //z = dimz-1
-    for (int y = 0; y < dilatImageWithBorders.dimY() ; ++y){
-        for (int x = 0 ; x < dilatImageWithBorders.dimX() ; ++x){
+    for (IndexType y = 0; y < new_dimy ; ++y){
+        for (IndexType x = 0 ; x < new_dimx ; ++x){
             b[(new_dimz-1)*new_dimx*new_dimy+y*new_dimx+x] = 0;
         }
     }
 
     //x = 0
-    for (int z = 0 ; z < dilatImageWithBorders.dimZ() ; ++z){
-        for (int y = 0 ; y < dilatImageWithBorders.dimY() ; ++y){
+    for (IndexType z = 0 ; z < new_dimz ; ++z){
+        for (IndexType y = 0 ; y < new_dimy ; ++y){
             b[z*new_dimx*new_dimy+y*new_dimx] = 0;
         }
     }
 
     //x = dimx-1
-    for (int z = 0 ; z < dilatImageWithBorders.dimZ() ; ++z){
-        for (int y = 0 ; y < dilatImageWithBorders.dimY() ; ++y){
+    for (IndexType z = 0 ; z < new_dimz ; ++z){
+        for (IndexType y = 0 ; y < new_dimy ; ++y){
             b[z*new_dimx*new_dimy+y*new_dimx+new_dimx-1] = 0;
         }
     }
 
     // y = 0
-    for (int z = 0 ; z < dilatImageWithBorders.dimZ(); ++z){
-        for (int x = 0 ; x < dilatImageWithBorders.dimX() ; ++x){
+    for (IndexType z = 0 ; z < new_dimz ; ++z){
+        for (IndexType x = 0 ; x < new_dimx ; ++x){
             b[z*new_dimy*new_dimx+x] = 0;
         }
     }
 
     // y = dimy-1
-    for (int z = 0 ; z < dilatImageWithBorders.dimZ() ; ++z){
-        for (int x = 0 ; x < dilatImageWithBorders.dimX() ; ++x){
+    for (IndexType z = 0 ; z < new_dimz ; ++z){
+        for (IndexType x = 0 ; x < new_dimx ; ++x){
             b[z*new_dimy*new_dimx+(new_dimy-1)*new_dimx+x] = 0;
         }
     }
@@ -110,50 +105,25 @@ void Stuff_PO(Image3D<T> &dilatImageWithBorders,
     // ############################ Mask treatment #############################
     if (!Mask.empty())
     {
-        Image3D<MaskType> Mask_dilat = Mask.add_border(2);
+        // Bit-packed mask with the same border as the image
+        Bitset3D Mask_dilat = Bitset3D::from_mask(Mask, 2);
 
+        // Dilation by the rect3dminmax box of width r_dilat (made odd)
         int r_dilat= L/2;
+        Mask_dilat.dilate(r_dilat > 1 ? (r_dilat | 1) / 2 : 0);
 
-        // Mask dynamic [0 1] ==> [0 255] for the dilation
-        int ind=0;
-        for(int z = 0; z < Mask_dilat.dimZ(); ++z) {
-            for(int y = 0 ; y < Mask_dilat.dimY(); ++y) {
-                for(int x = 0; x < Mask_dilat.dimX(); ++x) {
-                    if (Mask_dilat(x,y,z) != 0){
-                        Mask_dilat(x,y,z) = 255;
-                        ind += 1;
-                    }
-                }
-            }
-        }
-
-        // Dilation
-        rect3dminmax(Mask_dilat.get_pointer(), Mask_dilat.dimX(),
-                     Mask_dilat.dimY(), Mask_dilat.dimZ(),
-                     r_dilat, r_dilat, r_dilat, false);
-
-        ind = 0;
-        for(int z = 0; z < Mask_dilat.dimZ(); ++z) {
-            for(int y = 0 ; y < Mask_dilat.dimY(); ++y) {
-                for(int x = 0; x < Mask_dilat.dimX(); ++x) {
-                    if (Mask_dilat(x,y,z) == 0){
-                        b[z*new_dimy*new_dimx+y*new_dimx+x] = 0;
-                        ind += 1;
-                    }
-                }
-            }
-        }
+        Mask_dilat.clear_unset(b);
     }
 }
 
 
-template<typename T, typename MaskType>
-std::array<std::vector<int>, 7> RPO(const Image3D<T> &image, int L, Image3D<T> &RPO1,
-                                    Image3D<T> &RPO2, Image3D<T> &RPO3, Image3D<T> &RPO4,
-                                    Image3D<T> &RPO5, Image3D<T> &RPO6, Image3D<T> &RPO7,
-                                    int nb_core, int dilationSize, Image3D<MaskType> &Mask) {
-
-    Image3D<T> *RPOs[7] = {&RPO1, &RPO2, &RPO3, &RPO4, &RPO5, &RPO6, &RPO7};
+// Compute the 7 orientations of the Robust Path Opening. Each orientation is
+// computed in a bordered image owned by its task, then handed to
+// store(i, bordered image) (i from 0 to 6), still in the task.
+template<typename T, typename MaskType, typename Store>
+std::array<std::vector<int>, 7> RPO_orientations(const Image3DConstView<T> &image, int L,
+                                                 int nb_core, int dilationSize, const Image3DConstView<MaskType> &Mask,
+                                                 PO_Layout layout, Store store) {
 
     // #################### Definition of the orientations #########################
     // orientation vector
@@ -167,67 +137,246 @@ std::array<std::vector<int>, 7> RPO(const Image3D<T> &image, int L, Image3D<T> &
             std::vector<int>{-1, 1, -1},//7
     };
 
-    // ################### Dilation + Add border on image ######################
-
-	// Dilatation
-    Image3D<T> imageDilat=image.copy_image();
-
-    rect3dminmax(imageDilat.get_pointer(), imageDilat.dimX(), imageDilat.dimY(),
-                 imageDilat.dimZ(), dilationSize, dilationSize, dilationSize, false);
-
-    Image3D<T> dilatImageWithBorders=imageDilat.add_border(2);
-    imageDilat.clear_image();
+    // The dilations and the PO tasks use nb_core threads
+    omp_set_num_threads(nb_core);
 
-    for (auto rpo: RPOs)
-        rpo->copy_image(dilatImageWithBorders);
+    // ################### Dilation + Add border on image ######################
 
-    std::vector<long> index_image;
-    std::vector<bool>b(dilatImageWithBorders.size(),1);
+    // The image (or the view) is copied once with a 2-pixel halo, and dilated
+    // in place on the interior of the halo
+    const IndexType new_dimx = image.dimX() + 4;
+    const IndexType new_dimy = image.dimY() + 4;
+    const IndexType new_dimz = image.dimZ() + 4;
 
-    Stuff_PO(dilatImageWithBorders, index_image, L, b, Mask);
+    if (!fits_index_type((std::size_t) new_dimx * new_dimy * new_dimz)) {
+        std::cerr<<"Error in RPO.hpp : image of "<<(std::size_t) new_dimx * new_dimy * new_dimz
+                 <<" voxels is too large for the index type, rebuild without RORPO_32BIT_INDEX"<<std::endl;
+        return orientations;
+    }
 
+    Image3D<T> dilatImageWithBorders;
+    std::vector<IndexType> index_image;
+    std::vector<bool> b;
+
+    // Bricked layout: the sorted indices and b are converted once and shared
+    // by the 7 orientations
+    BrickLayout bricks(new_dimx, new_dimy, new_dimz);
+    std::vector<IndexType> brick_index;
+    std::vector<bool> brick_b;
+    std::vector<IndexType> brick_to_linear;
+
+    // Cost model (see POCostModel.hpp): the orientations start longest first,
+    // and in the linear layout those which would leave threads idle at the end
+    // are split in slabs of planes (see PO_3D_slab), each slab being thick
+    // enough to keep the overlap of the slabs below the slab itself
+    PO_Cost_Model &cost_model = PO_Cost_Model::instance();
+    std::array<PO_Layout, 7> po_layout;
+    std::array<std::size_t, 7> po_size;
+    std::array<double, 7> cost;
+    std::array<bool, 7> splittable;
+    for (int i = 0; i < (int) orientations.size(); ++i) {
+        po_layout[i] = layout;
+        po_size[i] = (std::size_t) new_dimx * new_dimy * new_dimz;
+        if (layout == PO_Layout::Bricked)
+            po_size[i] = bricks.size();
+        else if (layout == PO_Layout::Skewed) {
+            if (SkewLayout::is_diagonal(orientations[i]) &&
+                fits_index_type(SkewLayout(new_dimx, new_dimy, new_dimz, orientations[i]).size()))
+                po_size[i] = SkewLayout(new_dimx, new_dimy, new_dimz, orientations[i]).size();
+            else
+                po_layout[i] = PO_Layout::Linear;
+        }
+        cost[i] = cost_model.estimate(i, po_layout[i], po_size[i], L);
+        splittable[i] = po_layout[i] == PO_Layout::Linear;
+    }
+    const std::array<int, 7> po_slabs = PO_Cost_Model::split(cost, splittable, nb_core,
+                                                             (int) (new_dimz / (2 * (L + 1))),
+                                                             2.0 * (L + 1) / new_dimz);
+
+    // The split orientations have the same slabs, their sorted indices are
+    // partitioned once (PO_slab_indices) with the sort
+    const int split_slabs = *std::max_element(po_slabs.begin(), po_slabs.end());
+    std::vector<std::vector<IndexType>> slab_index;
+
+    // ############################ Task graph #################################
+
+    // dilation -> sort -> (bricks) -> 7 PO, b being computed alongside the
+    // dilation and the sort. Each buffer is freed after its last reader.
+    // The buffers read by all the orientations are interleaved across the
+    // NUMA nodes (see Image_Numa.hpp), the PO of an orientation allocates
+    // its own buffers on the node of its worker.
+    Numa_Placement &numa = Numa_Placement::instance();
+    Task_Graph graph;
+    const Task_Graph::Buffer dilated = graph.buffer([&]() { dilatImageWithBorders.clear_image(); });
+    const Task_Graph::Buffer sorted = graph.buffer([&]() { std::vector<IndexType>().swap(index_image); });
+    const Task_Graph::Buffer sorted_slabs = graph.buffer([&]() { std::vector<std::vector<IndexType>>().swap(slab_index); });
+    const Task_Graph::Buffer border = graph.buffer([&]() { std::vector<bool>().swap(b); });
+    const Task_Graph::Buffer sorted_bricks = graph.buffer([&]() { std::vector<IndexType>().swap(brick_index); });
+    const Task_Graph::Buffer border_bricks = graph.buffer([&]() { std::vector<bool>().swap(brick_b); });
+    const Task_Graph::Buffer bricks_linear = graph.buffer([&]() { std::vector<IndexType>().swap(brick_to_linear); });
+
+    graph.task([&]() {
+        dilatImageWithBorders = Image3D<T>::from_view(image, 2);
+
+        // Dilatation
+        rect3dminmax(dilatImageWithBorders.interior_pointer(), image.dimX(), image.dimY(),
+                     image.dimZ(), dilatImageWithBorders.dimX(),
+                     (ptrdiff_t) dilatImageWithBorders.dimX() * dilatImageWithBorders.dimY(),
+                     dilationSize, dilationSize, dilationSize, false);
+        numa.interleave(dilatImageWithBorders.get_pointer(), dilatImageWithBorders.size() * sizeof(T));
+        Huge_Pages::instance().account(dilatImageWithBorders.get_pointer(), dilatImageWithBorders.size() * sizeof(T));
+    }, {}, {dilated}, true);
 
+    // Sort the grey level intensity in a vector
+    graph.task([&]() {
+        index_image = sort_image_value<T,IndexType>(dilatImageWithBorders.get_pointer(),
+                                                    dilatImageWithBorders.size());
+        numa.interleave(index_image.data(), index_image.size() * sizeof(IndexType));
+        if (split_slabs > 1)
+            slab_index = PO_slab_indices(index_image, (IndexType) new_dimx * new_dimy, new_dimz, L, split_slabs);
+    }, {dilated}, {sorted, sorted_slabs}, true);
+
+    graph.task([&]() {
+        b.assign((std::size_t) new_dimx * new_dimy * new_dimz, 1);
+        PO_border_mask<MaskType>(new_dimx, new_dimy, new_dimz, L, b, Mask);
+    }, {}, {border});
+
+    if (layout == PO_Layout::Bricked) {
+        graph.task([&]() {
+            brick_index = bricks.from_linear(index_image);
+            numa.interleave(brick_index.data(), brick_index.size() * sizeof(IndexType));
+        }, {sorted}, {sorted_bricks});
+        graph.task([&]() { brick_b = bricks.to_bricks(b, false); }, {border}, {border_bricks});
+        graph.task([&]() {
+            brick_to_linear = bricks.linear_indices();
+            numa.interleave(brick_to_linear.data(), brick_to_linear.size() * sizeof(IndexType));
+        }, {}, {bricks_linear});
+    }
 
     // ############################ COMPUTE PO #################################
 
-
 	std::cout<<"------- RPO computation with scale " <<L<< "-------"<<std::endl;
 
+    auto passed = [&](int i, int slabs) {
+        #pragma omp critical(RPO_log)
+        {
+            std::cout << "orientation" << i + 1 << " "
+                      << orientations[i][0] << " "
+                      << orientations[i][1] << " "
+                      << orientations[i][2] << " : passed";
+            if (slabs > 1)
+                std::cout << " (" << slabs << " slabs)";
+            std::cout << std::endl;
+        }
+    };
+
+    // Outputs of the split orientations, written slab by slab
+    std::array<Image3D<T>, 7> split_outputs;
+
     // Calling PO for each orientation
-    omp_set_num_threads(nb_core);
+    for (int i = 0; i < (int) orientations.size(); ++i) {
+        const int slabs = po_slabs[i];
+
+        if (slabs == 1) {
+            const std::vector<Task_Graph::Buffer> inputs = layout == PO_Layout::Bricked ?
+                std::vector<Task_Graph::Buffer>{dilated, sorted_bricks, border_bricks, bricks_linear} :
+                std::vector<Task_Graph::Buffer>{dilated, sorted, border};
+            graph.task([&, i]() {
+                Image3D<T> Output = dilatImageWithBorders.copy_image();
+                Huge_Pages::instance().account(Output.get_pointer(), Output.size() * sizeof(T));
+                const double start = omp_get_wtime();
+                if (po_layout[i] == PO_Layout::Bricked)
+                    PO_3D<T, MaskType>(bricks, L, brick_index, orientations[i], Output, brick_b, brick_to_linear);
+                else if (po_layout[i] == PO_Layout::Skewed)
+                    PO_3D_skewed<T, MaskType>(dilatImageWithBorders, L, index_image, orientations[i], Output, b);
+                else
+                    PO_3D<T, MaskType>(dilatImageWithBorders, L, index_image, orientations[i], Output, b);
+                cost_model.record(i, po_layout[i], po_size[i], L, omp_get_wtime() - start);
+                store(i, Output);
+                passed(i, 1);
+            }, inputs, {}, false, cost[i]);
+            continue;
+        }
 
-    #ifdef OMP
-    #pragma omp parallel shared(dilatImageWithBorders, index_image)
-    {
-        #pragma omp single nowait
-        {
-            for (int i = 0; i < orientations.size(); ++i) {
-                #pragma omp task
-                {
-                    PO_3D<T, MaskType>(dilatImageWithBorders, L, index_image, orientations[i], *RPOs[i], b);
-                    std::cout << "orientation" << i + 1 << " "
-                              << orientations[i][0] << " "
-                              << orientations[i][1] << " "
-                              << orientations[i][2] << " : passed"
-                              << std::endl;
-                }
-            }
+        const Task_Graph::Buffer output = graph.buffer([&, i]() { split_outputs[i].clear_image(); });
+        graph.task([&, i]() {
+            split_outputs[i] = dilatImageWithBorders.copy_image();
+        }, {dilated}, {output}, false, cost[i]);
+
+        std::vector<Task_Graph::Buffer> parts;
+        for (int j = 0; j < slabs; ++j) {
+            const PO_Slab slab(new_dimz, L, slabs, j);
+            parts.push_back(graph.buffer());
+            graph.task([&, i, j, slab]() {
+                const double start = omp_get_wtime();
+                const std::size_t voxels = PO_3D_slab<T, MaskType>(dilatImageWithBorders, L, slab_index[j], orientations[i],
+                                                                   split_outputs[i], b, slab);
+                cost_model.record(i, PO_Layout::Linear, voxels, L, omp_get_wtime() - start);
+            }, {dilated, sorted_slabs, border, output}, {parts.back()}, false, cost[i] / slabs);
         }
+
+        parts.push_back(output);
+        graph.task([&, i]() {
+            store(i, split_outputs[i]);
+            passed(i, slabs);
+        }, parts);
     }
-    #endif
 
-	 std::cout<<"RPO computation completed"<<std::endl;
+    graph.run(nb_core);
 
-    dilatImageWithBorders.clear_image();
+	 std::cout<<"RPO computation completed"<<std::endl;
 
-    // Minimum between the computed RPO on the dilation and the initial image
-    // + remove borders
-    for (auto rpo: RPOs)
-    {
-        rpo->remove_border(2);
-        min_crush(*rpo, image);
-    }
     return orientations;
 }
 
+
+template<typename T, typename MaskType>
+std::array<std::vector<int>, 7> RPO(const Image3DConstView<T> &image, int L, Image3D<T> &RPO1,
+                                    Image3D<T> &RPO2, Image3D<T> &RPO3, Image3D<T> &RPO4,
+                                    Image3D<T> &RPO5, Image3D<T> &RPO6, Image3D<T> &RPO7,
+                                    int nb_core, int dilationSize, const Image3DConstView<MaskType> &Mask,
+                                    PO_Layout layout = PO_Layout::Linear) {
+
+    Image3D<T> *RPOs[7] = {&RPO1, &RPO2, &RPO3, &RPO4, &RPO5, &RPO6, &RPO7};
+
+    return RPO_orientations<T, MaskType>(image, L, nb_core, dilationSize, Mask, layout,
+        [&](int i, Image3D<T> &Output) {
+            // Minimum between the computed RPO on the dilation and the initial image
+            // + remove borders, in the same pass
+            Output.remove_halo(image, [](const T& a, const T& b) {
+                return std::min(a, b);
+            });
+            *RPOs[i] = std::move(Output);
+        });
+}
+
+
+// Same as above, the 7 orientations being written in responses (planar or
+// interleaved, see OrientationResponses.hpp), which is resized to the image
+template<typename T, typename MaskType>
+std::array<std::vector<int>, 7> RPO(const Image3DConstView<T> &image, int L, OrientationResponses<T> &responses,
+                                    int nb_core, int dilationSize, const Image3DConstView<MaskType> &Mask,
+                                    PO_Layout layout = PO_Layout::Linear) {
+
+    if (responses.dimX() != image.dimX() || responses.dimY() != image.dimY() || responses.dimZ() != image.dimZ()
+        || responses.empty())
+        responses = OrientationResponses<T>(image.dimX(), image.dimY(), image.dimZ(), responses.layout());
+
+    // The interleaved responses are written by all the orientations
+    if (responses.layout() == Responses_Layout::Interleaved)
+        Numa_Placement::instance().interleave(responses.get_pointer(), responses.size() * OrientationResponses<T>::LANES * sizeof(T));
+
+    return RPO_orientations<T, MaskType>(image, L, nb_core, dilationSize, Mask, layout,
+        [&](int i, Image3D<T> &Output) {
+            // Minimum between the computed RPO on the dilation and the initial image
+            Image3DView<T> response = responses.view(i);
+            for (unsigned int z = 0; z < image.dimZ(); ++z)
+                for (unsigned int y = 0; y < image.dimY(); ++y) {
+                    const T* row = &Output.interior(0, y, z);
+                    for (unsigned int x = 0; x < image.dimX(); ++x)
+                        response(x, y, z) = std::min(row[x], image(x, y, z));
+                }
+        });
+}
+
 #endif //RPO_INCLUDED
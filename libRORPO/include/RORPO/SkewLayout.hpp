@@ -0,0 +1,145 @@
+/* Copyright (C) 2014 Odyssee Merveille
+odyssee.merveille@gmail.com
+
+    This software is a computer program whose purpose is to compute RORPO.
+    This software is governed by the CeCILL-B license under French law and
+    abiding by the rules of distribution of free software.  You can  use,
+    modify and/ or redistribute the software under the terms of the CeCILL-B
+    license as circulated by CEA, CNRS and INRIA at the following URL
+    "http://www.cecill.info".
+
+    As a counterpart to the access to the source code and  rights to copy,
+    modify and redistribute granted by the license, users are provided only
+    with a limited warranty  and the software's author,  the holder of the
+    economic rights,  and the successive licensors  have only  limited
+    liability.
+
+    In this respect, the user's attention is drawn to the risks associated
+    with loading,  using,  modifying and/or developing or reproducing the
+    software by the user in light of its specific status of free software,
+    that may mean  that it is complicated to manipulate,  and  that  also
+    therefore means  that it is reserved for developers  and  experienced
+    professionals having in-depth computer knowledge. Users are therefore
+    encouraged to load and test the software's suitability as regards their
+    requirements in conditions enabling the security of their systems and/or
+    data to be ensured and,  more generally, to use and operate it in the
+    same conditions as regards security.
+
+    The fact that you are presently reading this means that you have had
+    knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#ifndef SKEWLAYOUT_INCLUDED
+#define SKEWLAYOUT_INCLUDED
+
+#include <vector>
+
+#include "RORPO/IndexType.hpp"
+
+// Sheared layout of a dimX x dimY x dimZ volume for a diagonal orientation
+// (sx, sy, sz): voxel (x, y, z) is stored at
+// (x - sx*sz*z + originX, y - sy*sz*z + originY, z) of a
+// (dimX + dimZ - 1) x (dimY + dimZ - 1) x dimZ volume.
+// A step along the orientation becomes a step of one plane, [0, 0, sz], and
+// the other neighbours keep constant offsets. Each row is kept contiguous,
+// so shearing and unshearing are streaming row copies. The rest of the
+// sheared volume is padding.
+class SkewLayout {
+
+public :
+
+	SkewLayout(IndexType dimX, IndexType dimY, IndexType dimZ, const std::vector<int> &orientation):
+		m_nSrcDimX(dimX), m_nSrcDimY(dimY), m_nSrcDimZ(dimZ),
+		m_nShearX(orientation[0] * orientation[2]), m_nShearY(orientation[1] * orientation[2]),
+		m_nDimX(dimX + dimZ - 1), m_nDimY(dimY + dimZ - 1), m_nDimZ(dimZ),
+		m_nOriginX(m_nShearX > 0 ? dimZ - 1 : 0), m_nOriginY(m_nShearY > 0 ? dimZ - 1 : 0) {}
+
+	// True for the orientations which are sheared ([±1, ±1, ±1])
+	static bool is_diagonal(const std::vector<int> &orientation) {
+		return orientation[0] != 0 && orientation[1] != 0 && orientation[2] != 0;
+	}
+
+	IndexType dimX() const {
+		return m_nDimX;
+	}
+
+	IndexType dimY() const {
+		return m_nDimY;
+	}
+
+	IndexType dimZ() const {
+		return m_nDimZ;
+	}
+
+	// Number of voxels of the sheared volume, padding included
+	IndexType size() const {
+		return m_nDimX * m_nDimY * m_nDimZ;
+	}
+
+	// Index of voxel (x, y, z) of the source volume
+	IndexType index(IndexType x, IndexType y, IndexType z) const {
+		return (x - m_nShearX * z + m_nOriginX)
+			+ (y - m_nShearY * z + m_nOriginY) * m_nDimX
+			+ z * m_nDimX * m_nDimY;
+	}
+
+	// Index of the voxel at index i of the source (linear) volume
+	IndexType from_linear(IndexType i) const {
+		return index(i % m_nSrcDimX, (i / m_nSrcDimX) % m_nSrcDimY, i / (m_nSrcDimX * m_nSrcDimY));
+	}
+
+	// Indices of the source volume converted to the sheared layout
+	std::vector<IndexType> from_linear(const std::vector<IndexType> &indices) const {
+		std::vector<IndexType> skewed(indices.size());
+		for (std::size_t i = 0; i < indices.size(); ++i)
+			skewed[i] = from_linear(indices[i]);
+		return skewed;
+	}
+
+	// Offset of the neighbour (dx, dy, dz) in the sheared layout
+	IndexType offset(int dx, int dy, int dz) const {
+		return (dx - m_nShearX * dz) + (dy - m_nShearY * dz) * m_nDimX + dz * m_nDimX * m_nDimY;
+	}
+
+	// Copy the source volume "in" in the sheared volume "out" (pointers or
+	// vectors), the padding of "out" is left untouched
+	template<typename In, typename Out>
+	void shear(const In &in, Out &&out) const {
+		for (IndexType z = 0; z < m_nSrcDimZ; ++z)
+			for (IndexType y = 0; y < m_nSrcDimY; ++y) {
+				const IndexType src = (y + z * m_nSrcDimY) * m_nSrcDimX;
+				const IndexType dst = index(0, y, z);
+				for (IndexType x = 0; x < m_nSrcDimX; ++x)
+					out[dst + x] = in[src + x];
+			}
+	}
+
+	// Copy the sheared volume "in" back in the source volume "out"
+	template<typename In, typename Out>
+	void unshear(const In &in, Out &&out) const {
+		for (IndexType z = 0; z < m_nSrcDimZ; ++z)
+			for (IndexType y = 0; y < m_nSrcDimY; ++y) {
+				const IndexType src = index(0, y, z);
+				const IndexType dst = (y + z * m_nSrcDimY) * m_nSrcDimX;
+				for (IndexType x = 0; x < m_nSrcDimX; ++x)
+					out[dst + x] = in[src + x];
+			}
+	}
+
+	private :
+		IndexType m_nSrcDimX;
+		IndexType m_nSrcDimY;
+		IndexType m_nSrcDimZ;
+
+		IndexType m_nShearX;
+		IndexType m_nShearY;
+
+		IndexType m_nDimX;
+		IndexType m_nDimY;
+		IndexType m_nDimZ;
+
+		IndexType m_nOriginX;
+		IndexType m_nOriginY;
+};
+
+#endif // SKEWLAYOUT_INCLUDED
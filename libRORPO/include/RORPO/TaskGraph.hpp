@@ -0,0 +1,306 @@
+/* Copyright (C) 2014 Odyssee Merveille
+odyssee.merveille@gmail.com
+
+    This software is a computer program whose purpose is to compute RORPO.
+    This software is governed by the CeCILL-B license under French law and
+    abiding by the rules of distribution of free software.  You can  use,
+    modify and/ or redistribute the software under the terms of the CeCILL-B
+    license as circulated by CEA, CNRS and INRIA at the following URL
+    "http://www.cecill.info".
+
+    As a counterpart to the access to the source code and  rights to copy,
+    modify and redistribute granted by the license, users are provided only
+    with a limited warranty  and the software's author,  the holder of the
+    economic rights,  and the successive licensors  have only  limited
+    liability.
+
+    In this respect, the user's attention is drawn to the risks associated
+    with loading,  using,  modifying and/or developing or reproducing the
+    software by the user in light of its specific status of free software,
+    that may mean  that it is complicated to manipulate,  and  that  also
+    therefore means  that it is reserved for developers  and  experienced
+    professionals having in-depth computer knowledge. Users are therefore
+    encouraged to load and test the software's suitability as regards their
+    requirements in conditions enabling the security of their systems and/or
+    data to be ensured and,  more generally, to use and operate it in the
+    same conditions as regards security.
+
+    The fact that you are presently reading this means that you have had
+    knowledge of the CeCILL-B license and that you accept its terms.
+*/
+
+#ifndef TASK_GRAPH_INCLUDED
+#define TASK_GRAPH_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <omp.h>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "Image/Image_Numa.hpp"
+
+// Graph of the stages of a computation, run by work-stealing threads: each
+// run() starts nb_threads - 1 threads next to the calling one and joins them
+// when the graph is done (there is no pool kept across the runs).
+// Each stage declares the buffers it reads (inputs) and writes (outputs): a
+// stage starts when the producers of its inputs are done, and a buffer is
+// released (its release function is called) as soon as its last reader is
+// done. A buffer is written by a single stage, declared before its readers,
+// so that the graph is acyclic by construction.
+//
+// Each worker runs the stages of its own deque (last pushed first, so that a
+// stage follows its producer on the same thread), then the shared queue, then
+// steals the oldest stage of another worker. The shared queue holds the
+// initial stages and the stages made ready together by a stage, by decreasing
+// priority (the estimated cost, so that the longest stages start first) then
+// in declaration order.
+// A stage runs its OpenMP loops with one thread, or, if it is declared
+// parallel, with the threads not used by the other running stages. With
+// Numa_Placement enabled, the serial stages of worker w run on the cpus of
+// node w % nodes(), so that their buffers are allocated on that node, and the
+// parallel stages, like the caller after run(), with the affinity the worker
+// had before.
+// If a stage throws, no other stage is started: run() waits for the running
+// ones and rethrows the first exception.
+class Task_Graph {
+
+public :
+
+	typedef std::size_t Buffer;
+	typedef std::size_t Task;
+
+	// Buffer released by release() (may be empty) after its last reader. A
+	// buffer without reader is left to its owner.
+	Buffer buffer(std::function<void()> release = nullptr) {
+		m_vBuffers.push_back(Buffer_State());
+		m_vBuffers.back().release = std::move(release);
+		return m_vBuffers.size() - 1;
+	}
+
+	Task task(std::function<void()> run, const std::vector<Buffer> &inputs = {},
+			  const std::vector<Buffer> &outputs = {}, bool parallel = false, double priority = 0) {
+		const Task t = m_vTasks.size();
+		m_vTasks.push_back(Task_State());
+		Task_State &state = m_vTasks.back();
+		state.run = std::move(run);
+		state.inputs = inputs;
+		state.parallel = parallel;
+		state.priority = priority;
+		for (Buffer b : inputs) {
+			m_vBuffers[b].nb_readers++;
+			const Task producer = m_vBuffers[b].producer;
+			if (producer != NO_TASK && std::find(state.predecessors.begin(), state.predecessors.end(), producer) == state.predecessors.end()) {
+				state.predecessors.push_back(producer);
+				m_vTasks[producer].successors.push_back(t);
+			}
+		}
+		for (Buffer b : outputs)
+			m_vBuffers[b].producer = t;
+		return t;
+	}
+
+	std::size_t size() const {
+		return m_vTasks.size();
+	}
+
+	// Run all the stages with nb_threads threads: the calling one and
+	// nb_threads - 1 threads started for this run
+	void run(int nb_threads) {
+		const std::size_t n = m_vTasks.size();
+		if (n == 0)
+			return;
+		m_nWidth = std::max(1, nb_threads);
+		m_nThreads = std::min(m_nWidth, (int) n);
+		const int omp_threads = omp_get_max_threads();
+
+		m_pPending.reset(new std::atomic<int>[n]);
+		for (std::size_t t = 0; t < n; ++t)
+			m_pPending[t] = (int) m_vTasks[t].predecessors.size();
+		m_pReaders.reset(new std::atomic<int>[m_vBuffers.size()]);
+		for (std::size_t b = 0; b < m_vBuffers.size(); ++b)
+			m_pReaders[b] = m_vBuffers[b].nb_readers;
+
+		// One deque per worker, the last one is the shared queue
+		m_vQueues.clear();
+		for (int w = 0; w <= m_nThreads; ++w)
+			m_vQueues.emplace_back(new Queue());
+		m_nQueued = 0;
+		for (Task t = 0; t < n; ++t)
+			if (m_pPending[t] == 0)
+				share(t);
+		m_nDone = 0;
+		m_nRunning = 0;
+		m_bFailed = false;
+		m_error = nullptr;
+
+		// If a thread cannot be started, the others steal the stages
+		std::vector<std::thread> threads;
+		try {
+			for (int w = 1; w < m_nThreads; ++w)
+				threads.emplace_back([this, w]() { work(w); });
+		}
+		catch (const std::system_error &) {
+		}
+		work(0);
+		for (std::thread &thread : threads)
+			thread.join();
+
+		omp_set_num_threads(omp_threads);
+		Numa_Placement::instance().unpin();
+		if (m_error)
+			std::rethrow_exception(m_error);
+	}
+
+private :
+
+	static const Task NO_TASK = (Task) -1;
+
+	struct Buffer_State {
+		std::function<void()> release;
+		Task producer = NO_TASK;
+		int nb_readers = 0;
+	};
+
+	struct Task_State {
+		std::function<void()> run;
+		std::vector<Buffer> inputs;
+		std::vector<Task> predecessors;
+		std::vector<Task> successors;
+		bool parallel = false;
+		double priority = 0;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	bool pop(int w, Task &t) {
+		// Own deque: last pushed first
+		{
+			Queue &own = *m_vQueues[w];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty()) {
+				t = own.tasks.back();
+				own.tasks.pop_back();
+				m_nQueued--;
+				return true;
+			}
+		}
+		// Shared queue, then the other workers: oldest first
+		for (int i = 0; i < m_nThreads; ++i) {
+			Queue &other = *m_vQueues[i == 0 ? m_nThreads : (w + i) % m_nThreads];
+			std::lock_guard<std::mutex> lock(other.mutex);
+			if (!other.tasks.empty()) {
+				t = other.tasks.front();
+				other.tasks.pop_front();
+				m_nQueued--;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void share(Task t) {
+		Queue &shared = *m_vQueues[m_nThreads];
+		std::lock_guard<std::mutex> lock(shared.mutex);
+		const double priority = m_vTasks[t].priority;
+		shared.tasks.insert(std::find_if(shared.tasks.begin(), shared.tasks.end(), [&](Task other) {
+			return m_vTasks[other].priority < priority || (m_vTasks[other].priority == priority && other > t);
+		}), t);
+		m_nQueued++;
+	}
+
+	void execute(int w, Task t) {
+		Task_State &state = m_vTasks[t];
+		Numa_Placement &numa = Numa_Placement::instance();
+		if (state.parallel)
+			numa.unpin();
+		else
+			numa.pin_worker(w);
+		const int running = ++m_nRunning;
+		omp_set_num_threads(state.parallel ? std::max(1, m_nWidth - running + 1) : 1);
+		try {
+			state.run();
+		}
+		catch (...) {
+			m_nRunning--;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_error)
+					m_error = std::current_exception();
+				m_bFailed = true;
+			}
+			m_cv.notify_all();
+			return;
+		}
+		m_nRunning--;
+
+		for (Buffer b : state.inputs)
+			if (--m_pReaders[b] == 0 && m_vBuffers[b].release)
+				m_vBuffers[b].release();
+
+		// A single ready successor stays on this worker, several ones are
+		// shared by priority
+		std::vector<Task> ready;
+		for (Task s : state.successors)
+			if (--m_pPending[s] == 0)
+				ready.push_back(s);
+		if (ready.size() == 1) {
+			Queue &own = *m_vQueues[w];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			own.tasks.push_back(ready[0]);
+			m_nQueued++;
+		}
+		else
+			for (Task s : ready)
+				share(s);
+
+		const bool last = ++m_nDone == m_vTasks.size();
+		if (ready.size() > 1 || last) {
+			{ std::lock_guard<std::mutex> lock(m_mutex); }
+			m_cv.notify_all();
+		}
+	}
+
+	void work(int w) {
+		while (!m_bFailed) {
+			Task t;
+			if (pop(w, t)) {
+				execute(w, t);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv.wait(lock, [this]() { return m_nQueued > 0 || m_nDone == m_vTasks.size() || m_bFailed; });
+			if (m_nQueued == 0 && m_nDone == m_vTasks.size())
+				return;
+		}
+	}
+
+	std::vector<Buffer_State> m_vBuffers;
+	std::vector<Task_State> m_vTasks;
+
+	int m_nWidth = 1;
+	int m_nThreads = 1;
+	std::unique_ptr<std::atomic<int>[]> m_pPending;
+	std::unique_ptr<std::atomic<int>[]> m_pReaders;
+	std::vector<std::unique_ptr<Queue>> m_vQueues;
+	std::atomic<int> m_nQueued{0};
+	std::atomic<std::size_t> m_nDone{0};
+	std::atomic<int> m_nRunning{0};
+	std::atomic<bool> m_bFailed{false};
+	std::exception_ptr m_error;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+};
+
+#endif // TASK_GRAPH_INCLUDED
@@ -42,6 +42,7 @@ knowledge of the CeCILL license and that you accept its terms.
 #ifndef GENFMAX_HPP
 #define GENFMAX_HPP
 
+ #include <stddef.h>
  #include "liarp.h"
 
 
@@ -49,7 +50,7 @@ template <typename Type>
 void genfmax(Type *f,
             Type *g,
             Type *h,
-            long *p,
+            ptrdiff_t *p,
             unsigned int nx, unsigned int K)
 
 {
@@ -42,13 +42,14 @@ knowledge of the CeCILL license and that you accept its terms.
 #ifndef GENFMIN_HPP
 #define GENFMIN_HPP
 
+#include <stddef.h>
 #include "liarp.h"
 
 template <typename Type>
 void genfmin(Type *f,
             Type *g,
             Type *h,
-            long *p,
+            ptrdiff_t *p,
             unsigned int nx, unsigned int K)
 
 {
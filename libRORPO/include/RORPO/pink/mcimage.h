@@ -67,6 +67,9 @@ extern "C" {
 #  define __pink__export export
 #  define __pink__import
 #  include <stdint.h>
+  typedef int64_t       int64_t_bis;
+  typedef uint64_t      uint64_t_bis;
+  typedef uint64_t      u_int64_t_bis;
 #else /* NOT UNIXIO */
 #  define __pink__inline
 #  define __pink__export __declspec(dllexport)
@@ -85,10 +88,11 @@ extern "C" {
 // attention : les index doivent être signés (pour les parcours rétro : for(i = N-1; i >=0; i--))
 #ifdef MC_64_BITS
 typedef int64_t_bis index_t;
+#define HUGE_IMAGE_SIZE INT64_MAX
 #else
 typedef int32_t index_t;
-#endif
 #define HUGE_IMAGE_SIZE INT32_MAX
+#endif
 
 // ********************************************************************************************************
 // ********************************************************************************************************
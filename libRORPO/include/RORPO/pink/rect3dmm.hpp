@@ -41,11 +41,216 @@ knowledge of the CeCILL license and that you accept its terms.
 #define RECT3DMM_HPP
 
 #include <math.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <omp.h>
+#include <vector>
 
 #include "liarp.h"
-#include "genfmin.hpp"
-#include "genfmax.hpp"
+
+/* min and max operations of rect3dminmax */
+template <typename Type>
+struct rect3d_min {
+  Type operator()(Type a, Type b) const { return liarmin(a, b); }
+};
+
+template <typename Type>
+struct rect3d_max {
+  Type operator()(Type a, Type b) const { return liarmax(a, b); }
+};
+
+/**
+ * \brief van Herk/Gil-Werman max/min of extent K (made odd, clipped at the
+    ends of the lines) on "width" lines at once: element i of line j is
+    f[i*stride + j]. The forward (g) and backward (h) arrays of all the lines
+    are computed together, so every inner loop runs over "width" contiguous
+    elements and is vectorized. Same result as genfmax/genfmin on each line.
+
+ * \param f:              first element of the first line (modified in place)
+ * \param stride:         offset between two elements of a line
+ * \param n:              number of elements in each line
+ * \param width:          number of lines
+ * \param K:              extent of the SE
+ * \param g, h:           scratch arrays of n*width elements
+*/
+template <typename Type, typename Op>
+void genfminmax_lines(Type *f, ptrdiff_t stride, int n, int width, int K,
+                      Type *g, Type *h, Op op)
+{
+  int i, j, start, end, lo, hi, r;
+
+  if (!(K%2))                     /* enforce the odd extent */
+    K++;
+  r = K>>1;
+
+  for (start = 0; start < n; start += K) {
+    end = start + K < n ? start + K : n;
+
+    /* do forward array */
+    for (j=0; j<width; ++j)
+      g[(ptrdiff_t)start*width + j] = f[start*stride + j];
+    for (i=start+1; i<end; ++i) {
+      const Type *fi = f + i*stride;
+      const Type *gp = g + (ptrdiff_t)(i-1)*width;
+      Type *gi = g + (ptrdiff_t)i*width;
+      #pragma omp simd
+      for (j=0; j<width; ++j)
+        gi[j] = op(fi[j], gp[j]);
+    }
+
+    /* do backward array */
+    for (j=0; j<width; ++j)
+      h[(ptrdiff_t)(end-1)*width + j] = f[(end-1)*stride + j];
+    for (i=end-2; i>=start; --i) {
+      const Type *fi = f + i*stride;
+      const Type *hn = h + (ptrdiff_t)(i+1)*width;
+      Type *hi_ = h + (ptrdiff_t)i*width;
+      #pragma omp simd
+      for (j=0; j<width; ++j)
+        hi_[j] = op(fi[j], hn[j]);
+    }
+  }
+
+  /* window [lo, hi] of each element: either across two blocks, or starting
+     at the first element of a block (left end), or ending at the last
+     element of a block (right end) */
+  for (i=0; i<n; ++i) {
+    lo = i - r < 0 ? 0 : i - r;
+    hi = i + r > n - 1 ? n - 1 : i + r;
+    Type *fi = f + i*stride;
+    const Type *gh = g + (ptrdiff_t)hi*width;
+    const Type *hl = h + (ptrdiff_t)lo*width;
+    if (lo / K != hi / K) {
+      #pragma omp simd
+      for (j=0; j<width; ++j)
+        fi[j] = op(hl[j], gh[j]);
+    }
+    else if (lo % K == 0) {
+      for (j=0; j<width; ++j)
+        fi[j] = gh[j];
+    }
+    else {
+      for (j=0; j<width; ++j)
+        fi[j] = hl[j];
+    }
+  }
+}
+
+/* Number of lines processed together by genfminmax_lines: a 1 KB chunk of
+   each row, so that the scratch arrays of a tile stay in cache */
+template <typename Type>
+int rect3dminmax_tile()
+{
+  return sizeof(Type) >= 1024 ? 1 : 1024 / sizeof(Type);
+}
+
+/* Scratch elements needed by each thread of rect3dminmax */
+template <typename Type>
+size_t rect3dminmax_scratch_size(int nx, int ny, int nz)
+{
+  int maxdim = nx<ny?ny:nx;
+  maxdim = maxdim<nz?nz:maxdim;
+  /* transposed tile of rows + forward and backward arrays */
+  return (size_t)3 * maxdim * rect3dminmax_tile<Type>();
+}
+
+template <typename Type, typename Op>
+void rect3dminmax(Type *in, int nx, int ny, int nz,
+		ptrdiff_t stride_y, ptrdiff_t stride_z, int w, int b,
+		int d, std::vector<Type> &scratch, Op op)
+{
+  const int tile = rect3dminmax_tile<Type>();
+  const size_t thread_scratch = rect3dminmax_scratch_size<Type>(nx, ny, nz);
+  if (scratch.size() < thread_scratch * omp_get_max_threads())
+    scratch.resize(thread_scratch * omp_get_max_threads());
+
+  #pragma omp parallel
+  {
+    Type *t = scratch.data() + thread_scratch * omp_get_thread_num();
+    Type *g = t + thread_scratch / 3;
+    Type *h = g + thread_scratch / 3;
+
+    /* if width of SE > 1 then perform max/min on each row: "tile" rows of a
+       slice are transposed in t, processed as columns and transposed back */
+    if (w > 1) {
+      int nb_tiles = (ny + tile - 1) / tile;
+      #pragma omp for collapse(2) schedule(static)
+      for (int i=0; i<nz; ++i)
+        for (int k=0; k<nb_tiles; ++k) {
+          int y0 = k * tile;
+          int width = ny - y0 < tile ? ny - y0 : tile;
+          Type *rows = in + i*stride_z + y0*stride_y;
+          for (int j=0; j<width; ++j)
+            for (int x=0; x<nx; ++x)
+              t[(ptrdiff_t)x*width + j] = rows[j*stride_y + x];
+          genfminmax_lines(t, (ptrdiff_t)width, nx, width, w, g, h, op);
+          for (int j=0; j<width; ++j)
+            for (int x=0; x<nx; ++x)
+              rows[j*stride_y + x] = t[(ptrdiff_t)x*width + j];
+        }
+    } /* end if (w>1) */
+
+    /* if y dimension of SE > 1 then perform max/min on each column,
+       "tile" columns of a slice at once */
+    if (b > 1) {
+      int nb_tiles = (nx + tile - 1) / tile;
+      #pragma omp for collapse(2) schedule(static)
+      for (int i=0; i<nz; ++i)
+        for (int k=0; k<nb_tiles; ++k) {
+          int x0 = k * tile;
+          int width = nx - x0 < tile ? nx - x0 : tile;
+          genfminmax_lines(in + i*stride_z + x0, stride_y, ny, width, b, g, h, op);
+        }
+    } /* end if (b>1) */
+
+    /* finally, if depth of SE > 1 then perform max/min on each slice,
+       "tile" voxels of a row at once */
+    if (d > 1) {
+      int nb_tiles = (nx + tile - 1) / tile;
+      #pragma omp for collapse(2) schedule(static)
+      for (int i=0; i<ny; ++i)
+        for (int k=0; k<nb_tiles; ++k) {
+          int x0 = k * tile;
+          int width = nx - x0 < tile ? nx - x0 : tile;
+          genfminmax_lines(in + i*stride_y + x0, stride_z, nz, width, d, g, h, op);
+        }
+    } /* end if (d>1) */
+  }
+} /* end rect3dminmax */
+
+/**
+ * \brief same as rect3dminmax, on a nx*ny*nz sub-volume of a larger buffer
+    (e.g. the interior of an image with a halo). Voxel (x, y, z) of the
+    sub-volume is in[x + y*stride_y + z*stride_z]; voxels outside of the
+    sub-volume are neither read nor written.
+    The lines are processed with SIMD, "rect3dminmax_tile" lines at once,
+    and the tiles are shared between the OpenMP threads. The scratch memory
+    is taken from "scratch", which is enlarged if needed: keep it from one
+    call to the next to avoid reallocations.
+
+ * \param stride_y:       offset between two rows of the buffer
+ * \param stride_z:       offset between two slices of the buffer
+ * \param scratch:        scratch memory
+*/
+template <typename Type>
+void rect3dminmax(Type *in, int nx, int ny, int nz,
+		ptrdiff_t stride_y, ptrdiff_t stride_z, int w, int b,
+		int d, bool usemin, std::vector<Type> &scratch)
+{
+  if (usemin)
+    rect3dminmax(in, nx, ny, nz, stride_y, stride_z, w, b, d, scratch, rect3d_min<Type>());
+  else
+    rect3dminmax(in, nx, ny, nz, stride_y, stride_z, w, b, d, scratch, rect3d_max<Type>());
+}
+
+template <typename Type>
+void rect3dminmax(Type *in, int nx, int ny, int nz,
+		ptrdiff_t stride_y, ptrdiff_t stride_z, int w, int b,
+		int d, bool usemin )
+{
+  std::vector<Type> scratch;
+  rect3dminmax(in, nx, ny, nz, stride_y, stride_z, w, b, d, usemin, scratch);
+}
 
 /**
  * \brief function to replace each voxel within a 3d image with
@@ -55,8 +260,8 @@ knowledge of the CeCILL license and that you accept its terms.
     equivelant of a rectangular structuring element.  The original image is
     described both by the image itself (*in) and the dimensions (nx, ny and
     nz) while the structuring element is described by its width, breadth and
-    depth (w, b and d).  The (*func)() argument is then used to specify
-    either erosion of dilation (genfmin for erosion and genfmax for dilation).
+    depth (w, b and d).  The usemin argument is then used to specify
+    either erosion of dilation (min for erosion and max for dilation).
     Note that this function does not create a new image but rather modifies the
     image supplied (*in).
 
@@ -71,7 +276,7 @@ knowledge of the CeCILL license and that you accept its terms.
  * \param w:              width (x dimension) of SE
  * \param b:              breadth (y dimension) of SE
  * \param d:              depth (z dimension) of SE
- * \param (*func)():      min or max operation (genfmin/genfmax)
+ * \param usemin:         min or max operation
 
  * \return
  * \author Ian Sowden
@@ -83,80 +288,7 @@ template <typename Type>
 void rect3dminmax(Type *in, int nx, int ny, int nz, int w, int b,
 		int d, bool usemin )
 {
-  int        i, j;               /* indexing variables */
-  int        maxdim;             /* maximum dimension */
-  Type      *row, *col, *slice; /* row/col/slice pointers */
-  Type      *h, *g;             /* fowards and backwards arrays (for func) */
-  long      *p;                 /* row/col/slice offset array */
-
-  /* Calculate max dimension */
-  maxdim = nx<ny?ny:nx;
-  maxdim = maxdim<nz?nz:maxdim;
-
-  /* Allocate memory for max/min and offset buffers */
-  /* calloc() args swapped */
-  g = (Type *)calloc(maxdim, sizeof(Type));
-  h = (Type *)calloc(maxdim, sizeof(Type));
-  p = (long *)calloc(maxdim, sizeof(long));
-
-
-  /* set row, col and slice buffers to start of image buffer */
-  row = col = slice = in;
-
-  /* if width of SE > 1 then perform max/min on each row */
-  if (w > 1) {
-    /* set row element offsets */
-    for (p[0]=0, i=1; i<nx; ++i)
-      p[i] = 1 + p[i-1];
-
-    /* gen max/min for each row (within each slice) */
-    if (usemin) {
-        for(i=0; i<(ny*nz); ++i, row+=nx)
-            genfmin(row, g, h, p, nx, w);
-    } else {
-        for(i=0; i<(ny*nz); ++i, row+=nx)
-            genfmax(row, g, h, p, nx, w);
-    }
-  } /* end if (w>1) */
-
-  /* if y dimension of SE > 1 then perform max/min on each column */
-  if (b > 1) {
-    /* set column element offsets */
-    for (p[0]=0, i=1; i<ny; ++i)
-      p[i] = nx + p[i-1];
-
-    if (usemin) {
-        for (i=0; i<nz; ++i, col+=((nx*ny)-nx))
-            for (j=0; j<nx; ++j, ++col)
-                genfmin(col, g, h, p, ny, b);
-    } else {
-        for (i=0; i<nz; ++i, col+=((nx*ny)-nx))
-            for (j=0; j<nx; ++j, ++col)
-                genfmax(col, g, h, p, ny, b);
-    }
-    /* gen max/min for each column (within each slice) */
-  } /* end if (b>1) */
-
-  /* finally, if depth of SE > 1 then perform max/min on each slice */
-  if (d > 1) {
-    /* set slice element offsets */
-    for (p[0]=0, i=1; i<nz; ++i)
-      p[i] = (nx*ny) + p[i-1];
-    /* gen max/min for each slice */
-    if (usemin) {
-        for (i=0; i<(nx*ny); ++i, ++slice)
-            genfmin(slice, g, h, p, nz, d);
-    } else {
-        for (i=0; i<(nx*ny); ++i, ++slice)
-            genfmax(slice, g, h, p, nz, d);
-    }
-  } /* end if (d>1) */
-
-  /* clean up */
-  free(g);
-  free(h);
-  free(p);
-
+  rect3dminmax(in, nx, ny, nz, (ptrdiff_t)nx, (ptrdiff_t)nx*ny, w, b, d, usemin);
 } /* end rect3dminmax */
 
 #if 0
@@ -33,71 +33,62 @@ odyssee.merveille@gmail.com
 #define SORTING_HPP_INCLUDED
 
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 #include "Image/Image.hpp"
 
+// Sorting network of 7 values held in registers, with branchless
+// compare-exchanges (a0 receives the smallest one), so that a loop calling it
+// runs on SIMD lanes of consecutive voxels.
+#define CMP_SWAP(x, y) { PixelType lo = y < x ? y : x; PixelType hi = y < x ? x : y; x = lo; y = hi; }
+
 template<typename PixelType>
-static inline void sort7_sorting_network_simple_swap(PixelType **d, std::array<uint8_t, 7>& indices) {
-
-#define SWAP(x, y) { if (*d[y] < *d[x]) { auto maxi = *d[x]; *d[x] = *d[y]; *d[y] = maxi; maxi=indices[x]; indices[x]=indices[y]; indices[y]=maxi;}}
-
-    SWAP(1, 2);
-    SWAP(3, 4);
-    SWAP(5, 6);
-    SWAP(0, 2);
-    SWAP(4, 6);
-    SWAP(3, 5);
-    SWAP(2, 6);
-    SWAP(1, 5);
-    SWAP(0, 4);
-    SWAP(2, 5);
-    SWAP(0, 3);
-    SWAP(2, 4);
-    SWAP(1, 3);
-    SWAP(0, 1);
-    SWAP(2, 3);
-    SWAP(4, 5);
-
-#undef SWAP
+static inline void sort7_network(PixelType &a0, PixelType &a1, PixelType &a2, PixelType &a3,
+                                 PixelType &a4, PixelType &a5, PixelType &a6) {
+    CMP_SWAP(a1, a2);
+    CMP_SWAP(a3, a4);
+    CMP_SWAP(a5, a6);
+    CMP_SWAP(a0, a2);
+    CMP_SWAP(a4, a6);
+    CMP_SWAP(a3, a5);
+    CMP_SWAP(a2, a6);
+    CMP_SWAP(a1, a5);
+    CMP_SWAP(a0, a4);
+    CMP_SWAP(a2, a5);
+    CMP_SWAP(a0, a3);
+    CMP_SWAP(a2, a4);
+    CMP_SWAP(a1, a3);
+    CMP_SWAP(a0, a1);
+    CMP_SWAP(a2, a3);
+    CMP_SWAP(a4, a5);
 }
 
-
+// Same network when only the ranks 2, 3, 4 and 7 (in increasing order, in a1,
+// a2, a3 and a6) are needed, as in RORPO: the comparator (4, 5) is dropped,
+// as well as the unused halves of the last ones once inlined.
 template<typename PixelType>
-static void sorting(Image3D<PixelType> &image1, Image3D<PixelType> &I2,
-                    Image3D<PixelType> &I3, Image3D<PixelType> &I4,
-                    Image3D<PixelType> &I5, Image3D<PixelType> &I6,
-                    Image3D<PixelType> &I7, int N,
-                    std::vector<std::array<uint8_t, 7>>& indices) {
-    PixelType *d[7];
-    d[0] = image1.get_pointer();
-    d[1] = I2.get_pointer();
-    d[2] = I3.get_pointer();
-    d[3] = I4.get_pointer();
-    d[4] = I5.get_pointer();
-    d[5] = I6.get_pointer();
-    d[6] = I7.get_pointer();
-
-
-    for (int i = 0; i < N; i++) {
-        indices[i] = {0, 1, 2, 3, 4, 5, 6};
-        sort7_sorting_network_simple_swap(d, indices[i]);
-        for (int j = 0; j < 7; j++)
-            d[j]++;
-    }
+static inline void rank7_network(PixelType &a0, PixelType &a1, PixelType &a2, PixelType &a3,
+                                 PixelType &a4, PixelType &a5, PixelType &a6) {
+    CMP_SWAP(a1, a2);
+    CMP_SWAP(a3, a4);
+    CMP_SWAP(a5, a6);
+    CMP_SWAP(a0, a2);
+    CMP_SWAP(a4, a6);
+    CMP_SWAP(a3, a5);
+    CMP_SWAP(a2, a6);
+    CMP_SWAP(a1, a5);
+    CMP_SWAP(a0, a4);
+    CMP_SWAP(a2, a5);
+    CMP_SWAP(a0, a3);
+    CMP_SWAP(a2, a4);
+    CMP_SWAP(a1, a3);
+    CMP_SWAP(a0, a1);
+    CMP_SWAP(a2, a3);
 }
 
-#ifdef _TEST_SORT_
-int main(int argc, char **argv) {
-   for (int i=0; i<10; i++){
-        PixelType d[7], *b[7];
-        for (int j=0;j<7; j++) {d[j]=rand()%256;b[j]=d+j;}
-        sort7_sorting_network_simple_swap(b);
-        for (int j=0; j<7; j++) std::cout<< d[j] << "--" ;
-        std::cout << std::endl;
-    }
-    int i;
-    std::cin >> i;
-}
-#endif // _TEST_SORT_
+#undef CMP_SWAP
+
 
 template<typename PixelType>
 bool my_sorting_function(const PixelType *i, const PixelType *j)
@@ -111,18 +102,25 @@ bool my_sorting_function(const PixelType *i, const PixelType *j)
 }
 
 template<typename PixelType, typename IndexType>
-std::vector<IndexType> sort_image_value(PixelType *image, int size)
+std::vector<IndexType> sort_image_value(PixelType *image, std::size_t size)
 //  Return pixels index of image sorted according to intensity
 {
-    std::vector<IndexType> index_image(size);
-    std::vector<PixelType *> index_pointer_adress(size);
+    // Both arrays are advised to use huge pages before being written
+    std::vector<IndexType> index_image;
+    std::vector<PixelType *> index_pointer_adress;
+    index_image.reserve(size);
+    index_pointer_adress.reserve(size);
+    Huge_Pages::instance().advise(index_image.data(), size * sizeof(IndexType));
+    Huge_Pages::instance().advise(index_pointer_adress.data(), size * sizeof(PixelType *));
+    index_image.resize(size);
+    index_pointer_adress.resize(size);
     IndexType it;
     typename std::vector<PixelType>::iterator it1;
     typename std::vector<PixelType *>::iterator it2;
     typename std::vector<IndexType>::iterator it3;
 
     // Fill index_pointer_adress with memory adress of variables in image
-    for (it = 0, it2 = index_pointer_adress.begin(); it != size; ++it, ++it2) {
+    for (it = 0, it2 = index_pointer_adress.begin(); it != (IndexType) size; ++it, ++it2) {
         *it2 = &image[it];
     }
 
@@ -131,9 +129,10 @@ std::vector<IndexType> sort_image_value(PixelType *image, int size)
               my_sorting_function<PixelType>);
 
     // Conversion from adresses to index of image I
-    for (it3 = index_image.begin(), it = 0; it != size; ++it, ++it3) {
+    for (it3 = index_image.begin(), it = 0; it != (IndexType) size; ++it, ++it3) {
         *it3 = static_cast<IndexType>(index_pointer_adress[it] - &image[0]);
     }
+    Huge_Pages::instance().account(index_image.data(), size * sizeof(IndexType));
     return index_image;
 }
 
@@ -20,13 +20,16 @@
         py::arg("dilationSize") = 2, \
         py::arg("verbose") = false, \
         py::arg("mask") = py::none(), \
-        py::arg("directions") = false \
+        py::arg("directions") = false, \
+        py::arg("directionsThreshold") = py::none(), \
+        py::arg("directionsInMask") = false, \
+        py::arg("directionCodes") = false \
     ); \
 
 namespace pyRORPO
 {
     template<typename PixelType>
-    py::array_t<PixelType> RORPO_binding(py::array_t<PixelType> imageArray,
+    py::array RORPO_binding(py::array_t<PixelType> imageArray,
                     int scale,
                     std::optional<std::vector<float>> spacingOpt,
                     std::optional<std::vector<double>> originOpt,
@@ -34,7 +37,10 @@ namespace pyRORPO
                     int dilationSize = 2,
                     int verbose = false,
                     std::optional<py::array_t<PixelType>> maskArray = py::none(),
-                    bool directions = false)
+                    bool directions = false,
+                    std::optional<double> directionsThreshold = std::nullopt,
+                    bool directionsInMask = false,
+                    bool directionCodes = false)
     {
         std::vector<int> window(3);
         window[2] = 0;
@@ -44,52 +50,52 @@ namespace pyRORPO
 
         // ---------------------------- Load image data ----------------------------
 
-        Image3D<PixelType> image = pyarrayToImage3D<PixelType>(imageArray, spacing, origin);
-        std::cout << "after arr2img: " << image.get_data()[0] << " : " << image.get_data()[1] <<  " : " <<image(2) <<  " : " <<image(3) <<  " : " <<image(4) << " : " << image(5) << std::endl;
+        Image3DView<const PixelType> image = pyarrayToImage3DView<PixelType>(imageArray, spacing, origin);
 
         // -------------------------- mask Image -----------------------------------
 
-        Image3D<PixelType> mask;
+        Image3DView<const PixelType> mask;
 
         if (maskArray)
-            mask = pyarrayToImage3D<PixelType>(*maskArray, spacing, origin);
+            mask = pyarrayToImage3DView<PixelType>(*maskArray, spacing, origin);
 
         // ------ Directions setup ----------
 
         std::shared_ptr<std::vector<int>> directionsResult = nullptr;
+        std::shared_ptr<std::vector<uint8_t>> directionCodesResult = nullptr;
 
-        if (directions) {
-            directionsResult = std::make_shared<std::vector<int>>(std::vector<int>(image.size() * 3, 0));
-        }
+        if (directionCodes)
+            directionCodesResult = std::make_shared<std::vector<uint8_t>>(image.size());
+        else if (directions)
+            directionsResult = std::make_shared<std::vector<int>>(image.size() * 3);
+
+        Directions_Domain directionsDomain;
+        directionsDomain.use_threshold = directionsThreshold.has_value();
+        directionsDomain.threshold = directionsThreshold.value_or(0);
+        directionsDomain.inside_mask = directionsInMask;
 
         // ---------------------------- Run RORPO ----------------------------------
 
-        Image3D<PixelType> output = RORPO<PixelType, PixelType>(
-            image,
-            scale,
-            nbCores,
-            dilationSize,
-            //verbose,
-            mask,
-            directionsResult
-        );
+        Image3D<PixelType> output;
+        if (directionCodes)
+            output = RORPO<PixelType, PixelType, uint8_t>(image, scale, nbCores, dilationSize, mask,
+                directionCodesResult, PO_Layout::Linear, Responses_Layout::Planar, directionsDomain);
+        else
+            output = RORPO<PixelType, PixelType>(image, scale, nbCores, dilationSize, mask,
+                directionsResult, PO_Layout::Linear, Responses_Layout::Planar, directionsDomain);
 
         // ---------------------------- Return results ------------------------------
 
-        if (directions) {
-            std::vector<PixelType> directionsImgType(directionsResult->begin(), directionsResult->end());
+        // Direction codes: the array owns the codes, nothing is copied
+        if (directionCodes)
+            return vectorToPyarray<uint8_t>(directionCodesResult, {output.dimZ(), output.dimY(), output.dimX()});
 
-            auto nbDim = output.dimY();
-            nbDim = 3;
-
-            py::array_t<PixelType> result = py::array_t<PixelType>({output.dimZ(), output.dimY(), output.dimX(), nbDim});
-
-            py::buffer_info buf3 = result.request();
-            PixelType* ptr = (PixelType*) buf3.ptr;
+        if (directions) {
+            py::array_t<PixelType> result = py::array_t<PixelType>({output.dimZ(), output.dimY(), output.dimX(), 3u});
 
-            memcpy(ptr, directionsImgType.data(), directionsImgType.size() * sizeof(PixelType));
+            PixelType* ptr = (PixelType*) result.request().ptr;
 
-            result.resize({output.dimZ(), output.dimY(), output.dimX(), nbDim});
+            std::copy(directionsResult->begin(), directionsResult->end(), ptr);
 
             return result;
         }
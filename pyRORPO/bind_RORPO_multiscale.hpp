@@ -6,6 +6,7 @@
 
 #include "RORPO/RORPO_multiscale.hpp"
 
+#include <memory>
 #include <optional>
 
 #define RORPO_MULTISCALE_BINDING(x) \
@@ -19,14 +20,20 @@
         py::arg("nbCores") = 1, \
         py::arg("dilationSize") = 2 , \
         py::arg("verbose") = false, \
-        py::arg("mask") = py::none() \
+        py::arg("mask") = py::none(), \
+        py::arg("bestScale") = false, \
+        py::arg("directions") = false, \
+        py::arg("directionsThreshold") = py::none(), \
+        py::arg("directionsInMask") = false, \
+        py::arg("directionCodes") = false, \
+        py::arg("memoryBudget") = 0 \
     ); \
 
 namespace pyRORPO
 {
 
     template<typename PixelType>
-    py::array_t<PixelType> RORPO_multiscale_binding(py::array_t<PixelType> imageArray,
+    py::object RORPO_multiscale_binding(py::array_t<PixelType> imageArray,
                     float scaleMin,
                     float factor,
                     int nbScales,
@@ -35,7 +42,13 @@ namespace pyRORPO
                     int nbCores = 1,
                     int dilationSize = 2,
                     int verbose = false,
-                    std::optional<py::array_t<PixelType>> maskArray = py::none())
+                    std::optional<py::array_t<PixelType>> maskArray = py::none(),
+                    bool bestScale = false,
+                    bool directions = false,
+                    std::optional<double> directionsThreshold = std::nullopt,
+                    bool directionsInMask = false,
+                    bool directionCodes = false,
+                    int memoryBudget = 0)
     {
         std::vector<int> window(3);
         window[2] = 0;
@@ -60,7 +73,7 @@ namespace pyRORPO
 
         // ---------------------------- Load image data ----------------------------
 
-        Image3D<PixelType> image = pyarrayToImage3D<PixelType>(imageArray, spacing, origin);
+        Image3DView<const PixelType> image = pyarrayToImage3DView<PixelType>(imageArray, spacing, origin);
 
         if (verbose){
             std::cout << "dimensions: [" << image.dimX() << ", " << image.dimY() << ", " << image.dimZ() << "]" << std::endl;
@@ -79,16 +92,59 @@ namespace pyRORPO
 
         // -------------------------- mask Image -----------------------------------
 
-        Image3D<PixelType> mask;
+        Image3DView<const PixelType> mask;
 
         if (maskArray)
-            mask = pyarrayToImage3D<PixelType>(*maskArray, spacing, origin);
+            mask = pyarrayToImage3DView<PixelType>(*maskArray, spacing, origin);
+
+        // ------ Best scale and directions setup ----------
+
+        std::shared_ptr<std::vector<uint8_t>> bestScaleResult = nullptr;
+        std::shared_ptr<std::vector<int>> directionsResult = nullptr;
+        std::shared_ptr<std::vector<uint8_t>> directionCodesResult = nullptr;
+
+        if (bestScale)
+            bestScaleResult = std::make_shared<std::vector<uint8_t>>(image.size());
+
+        if (directionCodes)
+            directionCodesResult = std::make_shared<std::vector<uint8_t>>(image.size());
+        else if (directions)
+            directionsResult = std::make_shared<std::vector<int>>(image.size() * 3);
+
+        Directions_Domain directionsDomain;
+        directionsDomain.use_threshold = directionsThreshold.has_value();
+        directionsDomain.threshold = directionsThreshold.value_or(0);
+        directionsDomain.inside_mask = directionsInMask;
 
         // ---------------------- Run RORPO_multiscale -----------------------------
 
-        Image3D<PixelType> output = RORPO_multiscale<PixelType, PixelType>(image, scaleList, nbCores, dilationSize, verbose, mask);
+        Image3D<PixelType> output;
+        if (directionCodes)
+            output = RORPO_multiscale<PixelType, PixelType, uint8_t>(image, scaleList, nbCores, dilationSize, verbose, mask,
+                PO_Layout::Linear, bestScaleResult, directionCodesResult, directionsDomain, (std::size_t) memoryBudget << 20);
+        else
+            output = RORPO_multiscale<PixelType, PixelType>(image, scaleList, nbCores, dilationSize, verbose, mask,
+                PO_Layout::Linear, bestScaleResult, directionsResult, directionsDomain, (std::size_t) memoryBudget << 20);
+
+        // ---------------------------- Return results ------------------------------
+
+        if (!bestScale && !directions && !directionCodes)
+            return image3DToPyarray<PixelType>(output);
+
+        // (response, best scale, directions), None for what was not asked
+        std::vector<py::ssize_t> shape = {output.dimZ(), output.dimY(), output.dimX()};
+
+        py::object bestScaleArray = py::none();
+        if (bestScale)
+            bestScaleArray = vectorToPyarray<uint8_t>(bestScaleResult, shape);
+
+        py::object directionsArray = py::none();
+        if (directionCodes)
+            directionsArray = vectorToPyarray<uint8_t>(directionCodesResult, shape);
+        else if (directions)
+            directionsArray = vectorToPyarray<int>(directionsResult, {output.dimZ(), output.dimY(), output.dimX(), 3u});
 
-        return image3DToPyarray<PixelType>(output);
+        return py::make_tuple(image3DToPyarray<PixelType>(output), bestScaleArray, directionsArray);
     }
 
 } // namespace pyRORPO
\ No newline at end of file
@@ -27,4 +27,7 @@ PYBIND11_MODULE(pyRORPO, m) {
     BINDINGS_OF_TYPE(float);
     BINDINGS_OF_TYPE(double );
     BINDINGS_OF_TYPE(long double);
+
+    m.def("directionCodesTable", &directionCodesTable,
+        "Direction (3 ints) of each direction code returned by RORPO with directionCodes=True");
 }
\ No newline at end of file
@@ -4,22 +4,33 @@
 #include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 
+#include <memory>
+#include <vector>
+
 namespace py = pybind11;
 
 #include "Image/Image.hpp"
+#include "RORPO/DirectionCodes.hpp"
+#include "RORPO/OrientationResponses.hpp"
 
 namespace pyRORPO
 {
+    // Read-only view on the data of the numpy array, nothing is copied:
+    // imageInput must outlive the view. Numpy strides are in bytes.
     template<typename PixelType>
-    inline Image3D<PixelType> pyarrayToImage3D(py::array_t<PixelType>& imageInput, std::vector<float>& spacing,
+    inline Image3DView<const PixelType> pyarrayToImage3DView(const py::array_t<PixelType>& imageInput, std::vector<float>& spacing,
         std::vector<double>& origin)
     {
         auto bufImage = imageInput.request();
 
-        auto image = Image3D<PixelType>(
+        return Image3DView<const PixelType>(
+            (const PixelType*) bufImage.ptr,
             bufImage.shape[2], 
             bufImage.shape[1], 
             bufImage.shape[0], 
+            bufImage.strides[2] / (py::ssize_t) sizeof(PixelType),
+            bufImage.strides[1] / (py::ssize_t) sizeof(PixelType),
+            bufImage.strides[0] / (py::ssize_t) sizeof(PixelType),
             spacing[0],
             spacing[1],
             spacing[2],
@@ -27,10 +38,13 @@ namespace pyRORPO
             origin[1],
             origin[2]
         );
+    }
 
-        image.add_data_from_pointer((PixelType*) bufImage.ptr);
-
-        return image;
+    template<typename PixelType>
+    inline Image3D<PixelType> pyarrayToImage3D(py::array_t<PixelType>& imageInput, std::vector<float>& spacing,
+        std::vector<double>& origin)
+    {
+        return Image3D<PixelType>::from_view(pyarrayToImage3DView<PixelType>(imageInput, spacing, origin));
     }
 
     template<typename PixelType>
@@ -48,4 +62,58 @@ namespace pyRORPO
 
         return result;
     }
-}
\ No newline at end of file
+
+    // Array of shape (7, dimZ, dimY, dimX) on the data of the responses
+    // (planar or interleaved), nothing is copied: the array owns the responses.
+    template<typename PixelType>
+    inline py::array_t<PixelType> orientationResponsesToPyarray(OrientationResponses<PixelType>&& responses)
+    {
+        auto* owner = new OrientationResponses<PixelType>(std::move(responses));
+
+        py::capsule freeWhenDone(owner, [](void* p) {
+            delete reinterpret_cast<OrientationResponses<PixelType>*>(p);
+        });
+
+        const py::ssize_t bytes = sizeof(PixelType);
+        const py::ssize_t voxel = owner->voxel_stride() * bytes;
+
+        return py::array_t<PixelType>(
+            {(py::ssize_t) OrientationResponses<PixelType>::NB_ORIENTATIONS,
+             (py::ssize_t) owner->dimZ(), (py::ssize_t) owner->dimY(), (py::ssize_t) owner->dimX()},
+            {owner->orientation_stride() * bytes,
+             voxel * owner->dimX() * owner->dimY(), voxel * owner->dimX(), voxel},
+            owner->get_pointer(),
+            freeWhenDone);
+    }
+
+    // Array of the given shape on the data of a vector, nothing is copied:
+    // the array shares the ownership of the vector.
+    template<typename T>
+    inline py::array_t<T> vectorToPyarray(const std::shared_ptr<std::vector<T>>& vector, std::vector<py::ssize_t> shape)
+    {
+        auto* owner = new std::shared_ptr<std::vector<T>>(vector);
+
+        py::capsule freeWhenDone(owner, [](void* p) {
+            delete reinterpret_cast<std::shared_ptr<std::vector<T>>*>(p);
+        });
+
+        return py::array_t<T>(shape, (*owner)->data(), freeWhenDone);
+    }
+
+    // Array of shape (number of codes, 3): direction of each direction code
+    // (row 0 is the null direction). directionCodesTable()[codes] expands
+    // a map of direction codes.
+    inline py::array_t<int> directionCodesTable()
+    {
+        const Direction_Codes& codes = Direction_Codes::instance();
+
+        py::array_t<int> result = py::array_t<int>({(py::ssize_t) codes.size(), (py::ssize_t) 3});
+        int* ptr = (int*) result.request().ptr;
+
+        for (std::size_t c = 0; c < codes.size(); c++)
+            for (int i = 0; i < 3; i++)
+                ptr[c * 3 + i] = codes.vector((uint8_t) c)[i];
+
+        return result;
+    }
+}